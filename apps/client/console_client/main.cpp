@@ -4,6 +4,28 @@
 #include "logger.h"
 #include "network.h"
 
+libs::logger::Level toLoggerLevel(libs::network::LogLevel level)
+{
+    switch (level)
+    {
+    case libs::network::LogLevel::Debug:
+        return libs::logger::Level::Debug;
+    case libs::network::LogLevel::Info:
+        return libs::logger::Level::Info;
+    case libs::network::LogLevel::Warning:
+        return libs::logger::Level::Warning;
+    case libs::network::LogLevel::Error:
+        return libs::logger::Level::Error;
+    }
+
+    return libs::logger::Level::Info;
+}
+
+void printDatagramCounters(const libs::network::DatagramCounters &counters)
+{
+    LOG_INFO("Datagrams sent {}, dropped {}", counters.datagrams_, counters.dropped_);
+}
+
 void waitForUserCommand(libs::network::client::Client &client)
 {
     while (true)
@@ -11,7 +33,12 @@ void waitForUserCommand(libs::network::client::Client &client)
         std::string input;
         getline(std::cin, input);
 
-        if (input == "q" ||
+        if (input == "d" ||
+            input == "D")
+        {
+            printDatagramCounters(client.datagramCounters());
+        }
+        else if (input == "q" ||
             input == "Q" ||
             input == "c" ||
             input == "C")
@@ -24,14 +51,15 @@ void waitForUserCommand(libs::network::client::Client &client)
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    if (argc != 4 && argc != 5)
     {
         std::cerr << "Incorrect number of args: " << argc << std::endl;
-        std::cerr << "Must be 3:" << std::endl;
+        std::cerr << "Must be 3 or 4:" << std::endl;
         std::cerr << "1 - client name (string)" << std::endl;
         std::cerr << "2 - server port (int)" << std::endl;
         std::cerr << "3 - reconnect timeout in seconds (int)" << std::endl;
-        std::cerr << "Example: ./binary Client 8080 3" << std::endl;
+        std::cerr << "4 - transport (tcp/udp, optional)" << std::endl;
+        std::cerr << "Example: ./binary Client 8080 3 udp" << std::endl;
         return -1;
     }
 
@@ -59,6 +87,21 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    libs::network::Transport transport = libs::network::Transport::Tcp;
+    if (argc == 5)
+    {
+        const std::string kTransport = argv[4];
+        if (kTransport == "udp")
+        {
+            transport = libs::network::Transport::Udp;
+        }
+        else if (kTransport != "tcp")
+        {
+            std::cerr << "Unknown transport: " << kTransport << std::endl;
+            return -1;
+        }
+    }
+
     try
     {
         const std::string kAddress("127.0.0.1");
@@ -70,17 +113,29 @@ int main(int argc, char *argv[])
             return -1;
         }
 
-        libs::network::client::Client client([&](const std::string &message)
-                                             { LOG(message); });
+        libs::network::client::Client client([](libs::network::LogLevel level, std::string_view message)
+                                             { LOG_AT_LEVEL(toLoggerLevel(level), "{}", message); });
 
         std::future<void> user_command_future = std::async(&waitForUserCommand, std::ref(client));
-        LOG("Input \'q\' to quit");
+        LOG("Input \'q\' to quit, \'d\' to show datagram counters");
 
-        if (!client.start({kClientTitle, kAddress, serverPort, reconnectingTimeoutSec}))
+        libs::network::client::Client::Config config;
+        config.title_ = kClientTitle;
+        config.address_ = kAddress;
+        config.port_ = serverPort;
+        config.logLevel_ = libs::logger::Logger::isEnabled(libs::logger::Level::Debug) ? libs::network::LogLevel::Debug
+                                                                                       : libs::network::LogLevel::Info;
+        config.reconnectingTimeoutSeconds_ = reconnectingTimeoutSec;
+        config.transport_ = transport;
+
+        if (!client.start(config))
         {
-            LOG("Can't run client: " + kAddress + ":" + std::to_string(serverPort));
+            LOG_ERROR("Can't run client: {}:{}", kAddress, serverPort);
             return -1;
         }
+
+        if (transport == libs::network::Transport::Udp)
+            printDatagramCounters(client.datagramCounters());
     }
     catch (const std::exception &e)
     {
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "capture.h"
+
+namespace
+{
+    struct Statistics
+    {
+        std::atomic<std::uint64_t> records_{0};
+        std::atomic<std::uint64_t> bytes_{0};
+        std::atomic<std::uint64_t> failures_{0};
+    };
+
+    int connectTo(const std::string &address, int port, libs::network::Transport transport)
+    {
+        const int kFD = socket(AF_INET, transport == libs::network::Transport::Udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+        if (kFD == -1)
+            return -1;
+
+        sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+
+        if (inet_pton(AF_INET, address.c_str(), &serverAddr.sin_addr) <= 0 ||
+            connect(kFD, (sockaddr *)&serverAddr, sizeof(serverAddr)) == -1)
+        {
+            close(kFD);
+            return -1;
+        }
+
+        return kFD;
+    }
+
+    bool sendAll(int fd, std::string_view payload)
+    {
+        while (!payload.empty())
+        {
+            const ssize_t kSent = send(fd, payload.data(), payload.size(), MSG_NOSIGNAL);
+            if (kSent == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                return false;
+            }
+
+            payload.remove_prefix(kSent);
+        }
+
+        return true;
+    }
+
+    // Every shard replays its own subset of connections in file order,
+    // so the order within a connection is kept
+    void replayShard(const std::string &filePath, std::size_t shard, std::size_t shardsCount,
+                     const std::string &address, int port, double speed,
+                     std::chrono::steady_clock::time_point startTime, Statistics &statistics)
+    {
+        libs::network::capture::Reader reader;
+        if (!reader.open(filePath))
+        {
+            LOG_ERROR("Can't open capture file: {}", filePath);
+            return;
+        }
+
+        std::unordered_map<libs::network::ConnectionId, int> sockets;
+        libs::network::capture::Record record;
+
+        while (reader.next(record))
+        {
+            if (record.connectionId_ % shardsCount != shard)
+                continue;
+
+            if (speed > 0)
+                std::this_thread::sleep_until(
+                    startTime + std::chrono::nanoseconds(static_cast<std::uint64_t>(record.timestampNanoseconds_ / speed)));
+
+            auto it = sockets.find(record.connectionId_);
+
+            // Closed as captured, so the server sees the same connection churn
+            if (record.kind_ == libs::network::capture::RecordKind::Close)
+            {
+                if (it != sockets.end())
+                {
+                    if (it->second != -1)
+                        close(it->second);
+
+                    sockets.erase(it);
+                }
+                continue;
+            }
+
+            if (it == sockets.end())
+                it = sockets.emplace(record.connectionId_, connectTo(address, port, reader.transport())).first;
+
+            if (it->second == -1 || !sendAll(it->second, record.payload_))
+            {
+                statistics.failures_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            statistics.records_.fetch_add(1, std::memory_order_relaxed);
+            statistics.bytes_.fetch_add(record.payload_.size(), std::memory_order_relaxed);
+        }
+
+        for (const auto &[id, fd] : sockets)
+            if (fd != -1)
+                close(fd);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4 && argc != 5)
+    {
+        std::cerr << "Incorrect number of args: " << argc << std::endl;
+        std::cerr << "Must be 3 or 4:" << std::endl;
+        std::cerr << "1 - capture file path (string)" << std::endl;
+        std::cerr << "2 - server port (int)" << std::endl;
+        std::cerr << "3 - speed (1 - as captured, N - N times faster, max - no delays)" << std::endl;
+        std::cerr << "4 - replaying threads (int, optional)" << std::endl;
+        std::cerr << "Example: ./binary capture.bin 8080 10 4" << std::endl;
+        return -1;
+    }
+
+    const std::string kCaptureFilePath = argv[1];
+
+    int serverPort = 0;
+    double speed = 0;
+    int threadsCount = 4;
+    try
+    {
+        serverPort = std::stoi(argv[2]);
+
+        if (std::string(argv[3]) != "max")
+        {
+            speed = std::stod(argv[3]);
+            if (speed <= 0)
+                throw std::invalid_argument("Speed must be positive");
+        }
+
+        if (argc == 5)
+            threadsCount = std::max(1, std::stoi(argv[4]));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    const std::string kAddress("127.0.0.1");
+    const std::string kLogFilePath("log.txt");
+
+    if (!libs::logger::Logger::instance()->init(kLogFilePath))
+    {
+        std::cerr << "Can't init logger and saving log to file: " << kLogFilePath << std::endl;
+        return -1;
+    }
+
+    libs::network::capture::Reader reader;
+    if (!reader.open(kCaptureFilePath))
+    {
+        LOG_ERROR("Can't open capture file: {}", kCaptureFilePath);
+        return -1;
+    }
+
+    std::unordered_set<libs::network::ConnectionId> connections;
+    std::uint64_t recordsCount = 0;
+    std::uint64_t durationNanoseconds = 0;
+
+    libs::network::capture::Record record;
+    while (reader.next(record))
+    {
+        durationNanoseconds = record.timestampNanoseconds_;
+        if (record.kind_ != libs::network::capture::RecordKind::Data)
+            continue;
+
+        connections.insert(record.connectionId_);
+        ++recordsCount;
+    }
+
+    LOG_INFO("Replaying {} records of {} connections captured over {} ms",
+             recordsCount, connections.size(), durationNanoseconds / 1000000);
+
+    const std::size_t kShardsCount = std::min<std::size_t>(threadsCount, std::max<std::size_t>(1, connections.size()));
+
+    Statistics statistics;
+    const auto kStartTime = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (std::size_t shard = 0; shard < kShardsCount; ++shard)
+        threads.emplace_back(&replayShard, kCaptureFilePath, shard, kShardsCount, kAddress, serverPort,
+                             speed, kStartTime, std::ref(statistics));
+
+    for (auto &thread : threads)
+        thread.join();
+
+    const auto kElapsedMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                          std::chrono::steady_clock::now() - kStartTime)
+                                          .count();
+
+    LOG_INFO("Replayed {} records ({} bytes) in {} ms, failed: {}",
+             statistics.records_.load(), statistics.bytes_.load(), kElapsedMilliseconds,
+             statistics.failures_.load());
+
+    return 0;
+}
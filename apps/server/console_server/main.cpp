@@ -1,22 +1,67 @@
 #include <iostream>
-#include <future>
+#include <thread>
 
 #include "logger.h"
 #include "network.h"
 
+libs::logger::Level toLoggerLevel(libs::network::LogLevel level)
+{
+    switch (level)
+    {
+    case libs::network::LogLevel::Debug:
+        return libs::logger::Level::Debug;
+    case libs::network::LogLevel::Info:
+        return libs::logger::Level::Info;
+    case libs::network::LogLevel::Warning:
+        return libs::logger::Level::Warning;
+    case libs::network::LogLevel::Error:
+        return libs::logger::Level::Error;
+    }
+
+    return libs::logger::Level::Info;
+}
+
+void printTopClients(libs::network::server::Server &server)
+{
+    const auto kNow = std::chrono::system_clock::now();
+
+    for (const auto &client : server.topClients(10))
+    {
+        LOG_INFO("\"{}\": messages {}, bytes {}, last seen {} s ago",
+                 client.title_, client.messages_, client.bytes_,
+                 std::chrono::duration_cast<std::chrono::seconds>(kNow - client.lastSeen_).count());
+    }
+}
+
+void printDatagramCounters(const libs::network::DatagramCounters &counters)
+{
+    LOG_INFO("Datagrams received {}, truncated {}, dropped {}",
+             counters.datagrams_, counters.truncated_, counters.dropped_);
+}
+
 void waitForUserCommand(libs::network::server::Server &server)
 {
-    LOG("Input \'q\' to quit");
+    LOG("Input \'q\' to quit, \'s\' to show the heaviest clients, \'d\' to show datagram counters");
 
     while (true)
     {
         std::string input;
         getline(std::cin, input);
 
-        if (input == "q" ||
-            input == "Q" ||
-            input == "c" ||
-            input == "C")
+        if (input == "s" ||
+            input == "S")
+        {
+            printTopClients(server);
+        }
+        else if (input == "d" ||
+                 input == "D")
+        {
+            printDatagramCounters(server.datagramCounters());
+        }
+        else if (input == "q" ||
+                 input == "Q" ||
+                 input == "c" ||
+                 input == "C")
         {
             server.stop();
             break;
@@ -26,15 +71,37 @@ void waitForUserCommand(libs::network::server::Server &server)
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    if (argc < 2 || argc > 5)
     {
         std::cerr << "Incorrect number of args: " << argc << std::endl;
-        std::cerr << "Must be 1:" << std::endl;
+        std::cerr << "Must be from 1 to 4:" << std::endl;
         std::cerr << "1 - server port (int)" << std::endl;
-        std::cerr << "Example: ./binary 8080" << std::endl;
+        std::cerr << "2 - upgrade socket path (string, optional, \"-\" - none)" << std::endl;
+        std::cerr << "3 - transport (tcp/udp, optional)" << std::endl;
+        std::cerr << "4 - capture file path (string, optional)" << std::endl;
+        std::cerr << "Example: ./binary 8080 /tmp/console_server.sock udp capture.bin" << std::endl;
         return -1;
     }
 
+    const std::string kUpgradeSocketPath = argc >= 3 && std::string(argv[2]) != "-" ? argv[2] : "";
+
+    libs::network::Transport transport = libs::network::Transport::Tcp;
+    if (argc >= 4)
+    {
+        const std::string kTransport = argv[3];
+        if (kTransport == "udp")
+        {
+            transport = libs::network::Transport::Udp;
+        }
+        else if (kTransport != "tcp")
+        {
+            std::cerr << "Unknown transport: " << kTransport << std::endl;
+            return -1;
+        }
+    }
+
+    const std::string kCaptureFilePath = argc == 5 ? argv[4] : "";
+
     int serverPort = 0;
     try
     {
@@ -57,16 +124,30 @@ int main(int argc, char *argv[])
             return -1;
         }
 
-        libs::network::server::Server server([&](const std::string &message)
-                                             { LOG(message); });
+        libs::network::server::Server server([](libs::network::LogLevel level, std::string_view message)
+                                             { LOG_AT_LEVEL(toLoggerLevel(level), "{}", message); });
+
+        // Not joined: after hot upgrade the server returns without any user input
+        std::thread(&waitForUserCommand, std::ref(server)).detach();
 
-        std::future<void> user_command_future = std::async(&waitForUserCommand, std::ref(server));
+        libs::network::server::Server::Config config;
+        config.address_ = kAddress;
+        config.port_ = serverPort;
+        config.logLevel_ = libs::logger::Logger::isEnabled(libs::logger::Level::Debug) ? libs::network::LogLevel::Debug
+                                                                                       : libs::network::LogLevel::Info;
+        config.waitingTimeoutMilliseconds_ = 500;
+        config.upgradeSocketPath_ = kUpgradeSocketPath;
+        config.transport_ = transport;
+        config.captureFilePath_ = kCaptureFilePath;
 
-        if (!server.start({kAddress, serverPort, 500}))
+        if (!server.start(config))
         {
-            LOG("Fail of running server: " + kAddress + ":" + std::to_string(serverPort));
+            LOG_ERROR("Fail of running server: {}:{}", kAddress, serverPort);
             return -1;
         }
+
+        if (transport == libs::network::Transport::Udp)
+            printDatagramCounters(server.datagramCounters());
     }
     catch (const std::exception &e)
     {
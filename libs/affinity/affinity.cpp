@@ -0,0 +1,61 @@
+#include "affinity.h"
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace libs
+{
+    namespace affinity
+    {
+        bool pinCurrentThread(const std::vector<int> &cpus)
+        {
+            if (cpus.empty())
+                return true;
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (const int kCpu : cpus)
+            {
+                if (kCpu < 0 || kCpu >= CPU_SETSIZE)
+                    return false;
+
+                CPU_SET(kCpu, &set);
+            }
+
+            if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+                return false;
+
+            // Overrides e.g. an interleave policy inherited from numactl
+            syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0);
+
+            return true;
+        }
+
+        PlacementGuard::PlacementGuard()
+        {
+            CPU_ZERO(&cpus_);
+            hasCpus_ = pthread_getaffinity_np(pthread_self(), sizeof(cpus_), &cpus_) == 0;
+
+            const unsigned long kMaxNode = memoryNodes_.size() * sizeof(unsigned long) * 8;
+            hasMemoryPolicy_ = syscall(SYS_get_mempolicy, &memoryPolicy_, memoryNodes_.data(), kMaxNode, nullptr, 0) == 0;
+        }
+
+        PlacementGuard::~PlacementGuard()
+        {
+            apply();
+        }
+
+        void PlacementGuard::apply() const
+        {
+            if (hasCpus_)
+                pthread_setaffinity_np(pthread_self(), sizeof(cpus_), &cpus_);
+
+            // set_mempolicy reads one bit less than maxnode
+            const unsigned long kMaxNode = memoryNodes_.size() * sizeof(unsigned long) * 8 + 1;
+            if (hasMemoryPolicy_)
+                syscall(SYS_set_mempolicy, memoryPolicy_, memoryNodes_.data(), kMaxNode);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <sched.h>
+#include <array>
+#include <vector>
+
+namespace libs
+{
+    namespace affinity
+    {
+        // Pins the calling thread to the CPUs and switches its memory policy to
+        // local allocation, so buffers it touches first land on its NUMA node.
+        // Empty set leaves the thread as is
+        bool pinCurrentThread(const std::vector<int> &cpus);
+
+        // Remembers the calling thread's CPU mask and memory policy and restores
+        // them on destruction, for code pinning a thread it doesn't own
+        class PlacementGuard
+        {
+        public:
+            PlacementGuard();
+            ~PlacementGuard();
+
+            // Gives the calling thread the remembered placement, e.g. a thread spawned
+            // by an already pinned one, which inherits its mask and memory policy
+            void apply() const;
+
+            PlacementGuard(const PlacementGuard &) = delete;
+            PlacementGuard &operator=(const PlacementGuard &) = delete;
+
+        private:
+            cpu_set_t cpus_;
+            bool hasCpus_{false};
+
+            int memoryPolicy_{0};
+            std::array<unsigned long, 16> memoryNodes_{};
+            bool hasMemoryPolicy_{false};
+        };
+    }
+}
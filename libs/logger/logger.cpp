@@ -1,24 +1,66 @@
 #include "logger.h"
 
+#include "affinity.h"
+
+#include <fcntl.h>
+#include <unistd.h>
 #include <iostream>
-#include <fstream>
 #include <chrono>
 #include <iomanip>
 #include <ctime>
 #include <sstream>
 #include <string>
+#include <charconv>
+#include <cerrno>
+#include <cstdio>
+
+#define LOG_MESSAGE_RESERVE_SIZE 4096
 
 namespace
 {
-    bool writeToFile(const std::string &filePath, const std::string &message)
+    const char *levelTitle(libs::logger::Level level)
+    {
+        switch (level)
+        {
+        case libs::logger::Level::Trace:
+            return "[TRACE] ";
+        case libs::logger::Level::Debug:
+            return "[DEBUG] ";
+        case libs::logger::Level::Info:
+            return "[INFO] ";
+        case libs::logger::Level::Warning:
+            return "[WARNING] ";
+        case libs::logger::Level::Error:
+            return "[ERROR] ";
+        }
+
+        return "";
+    }
+
+    template <typename T>
+    void appendNumber(std::string &out, T value)
+    {
+        char buffer[32];
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        if (ec == std::errc())
+            out.append(buffer, end);
+    }
+
+    bool writeToFile(int fd, std::string_view message)
     {
-        std::ofstream f;
-        f.open(filePath, std::ios::app);
-        if (!f.is_open())
-            return false;
+        while (!message.empty())
+        {
+            const ssize_t kWritten = write(fd, message.data(), message.size());
+            if (kWritten == -1)
+            {
+                if (errno == EINTR)
+                    continue;
 
-        f << message << '\n';
-        f.close();
+                return false;
+            }
+
+            message.remove_prefix(kWritten);
+        }
 
         return true;
     }
@@ -28,13 +70,90 @@ namespace libs
 {
     namespace logger
     {
+        namespace details
+        {
+            void appendArgument(std::string &out, std::string_view value)
+            {
+                out.append(value);
+            }
+
+            void appendArgument(std::string &out, char value)
+            {
+                out.push_back(value);
+            }
+
+            void appendArgument(std::string &out, bool value)
+            {
+                out.append(value ? "true" : "false");
+            }
+
+            void appendArgument(std::string &out, long long value)
+            {
+                appendNumber(out, value);
+            }
+
+            void appendArgument(std::string &out, unsigned long long value)
+            {
+                appendNumber(out, value);
+            }
+
+            void appendArgument(std::string &out, double value)
+            {
+                appendNumber(out, value);
+            }
+
+            void appendArgument(std::string &out, const void *value)
+            {
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%p", value);
+                out.append(buffer);
+            }
+
+            bool nextPlaceholder(std::string &out, std::string_view &format)
+            {
+                while (!format.empty())
+                {
+                    const std::size_t kPosition = format.find_first_of("{}");
+                    if (kPosition == std::string_view::npos)
+                        break;
+
+                    out.append(format.substr(0, kPosition));
+
+                    const char kCurrent = format[kPosition];
+                    const char kNext = kPosition + 1 < format.size() ? format[kPosition + 1] : '\0';
+                    format.remove_prefix(kPosition + 1);
+
+                    if (kCurrent == '{' && kNext == '}')
+                    {
+                        format.remove_prefix(1);
+                        return true;
+                    }
+
+                    out.push_back(kCurrent);
+                    if (kNext == kCurrent)
+                        format.remove_prefix(1);
+                }
+
+                out.append(format);
+                format = {};
+                return false;
+            }
+        }
+
+        std::atomic<int> Logger::minLevel_{LOG_MIN_LEVEL};
+
+        void Logger::setLevel(Level level)
+        {
+            minLevel_.store(static_cast<int>(level), std::memory_order_relaxed);
+        }
+
         std::shared_ptr<Logger> Logger::instance()
         {
             static std::shared_ptr<Logger> instance(new Logger);
             return instance;
         }
 
-        Logger::Logger() : running_(false)
+        Logger::Logger() : running_(false), records_(std::make_unique<Record[]>(LOG_QUEUE_SIZE))
         {
             workerThread_ = std::thread(&Logger::doLog, this);
         }
@@ -47,53 +166,103 @@ namespace libs
             {
                 workerThread_.join();
             }
+
+            if (fileFD_.load() != -1)
+                close(fileFD_.load());
         }
 
         bool Logger::init(const std::string &filePath)
         {
-            Logger::instance()->filePath_ = filePath;
+            // Kept open, so writing a message is a single write(2)
+            const int kFD = open(filePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (kFD == -1 || !writeToFile(kFD, "Init message\n"))
+            {
+                if (kFD != -1)
+                    close(kFD);
 
-            if (writeToFile(filePath_, "Init message"))
-                return true;
+                std::cerr << "Error while creating file: " << filePath << std::endl;
+                return false;
+            }
+
+            filePath_ = filePath;
+
+            const int kPreviousFD = fileFD_.exchange(kFD);
+            if (kPreviousFD != -1)
+                close(kPreviousFD);
 
-            Logger::instance()->filePath_ = "";
-            std::cerr << "Error while creating file: " << filePath << std::endl;
-            return false;
+            return true;
         }
 
-        void Logger::signalToLog(const std::string &message)
+        bool Logger::setCpuAffinity(const std::vector<int> &cpus)
         {
-            {
-                std::lock_guard<std::mutex> lock(queueMutex_);
-                messageQueue_.push(message);
+            if (cpus.empty())
+                return true;
 
-                // messageQueue_.push("[" + getCurrentTime() + "] " + message);
-            }
+            // The worker pins itself, so it can reallocate its buffers afterwards
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            requestedCpus_ = cpus;
+            isAffinityRequested_ = true;
             condition_.notify_one();
+
+            affinityApplied_.wait(lock, [this]
+                                  { return !isAffinityRequested_; });
+            return isAffinitySet_;
         }
 
         void Logger::doLog()
         {
             running_.store(true);
 
-            while (running_.load() || !messageQueue_.empty())
+            std::string message;
+            message.reserve(LOG_MESSAGE_RESERVE_SIZE);
+
+            std::unique_lock<std::mutex> queueLock(queueMutex_);
+
+            while (running_.load() || queueSize_ != 0)
             {
-                std::unique_lock<std::mutex> queueLock(queueMutex_);
                 condition_.wait(queueLock, [this]
-                                { return !messageQueue_.empty() || !running_.load(); });
+                                { return queueSize_ != 0 || isAffinityRequested_ || !running_.load(); });
 
-                while (!messageQueue_.empty())
+                while (queueSize_ != 0)
                 {
-                    std::string message = messageQueue_.front();
-                    messageQueue_.pop();
+                    // Producers only fill slots behind the head, so it is safe to use it unlocked
+                    Record &record = records_[queueHead_];
                     queueLock.unlock();
 
-                    std::cout << message << std::endl;
+                    message.assign(levelTitle(record.level_));
+                    record.formatArguments_(message, record.format_, record.arguments_);
+                    record.destroyArguments_(record.arguments_);
+                    record.arena_.release();
+                    message.push_back('\n');
 
-                    if (!writeToFile(filePath_, message))
+                    std::cout << message << std::flush;
+
+                    const int kFD = fileFD_.load();
+                    if (kFD != -1 && !writeToFile(kFD, message))
                         std::cerr << "Error while writing to file: " << filePath_ << std::endl;
 
                     queueLock.lock();
+                    queueHead_ = (queueHead_ + 1) % LOG_QUEUE_SIZE;
+                    --queueSize_;
+                    notFull_.notify_one();
+                }
+
+                if (isAffinityRequested_)
+                {
+                    // The queue is empty, so records can be replaced by ones first touched
+                    // by the pinned thread, which puts them on its NUMA node
+                    isAffinitySet_ = affinity::pinCurrentThread(requestedCpus_);
+                    if (isAffinitySet_)
+                    {
+                        records_ = std::make_unique<Record[]>(LOG_QUEUE_SIZE);
+                        queueHead_ = 0;
+
+                        std::string().swap(message);
+                        message.reserve(LOG_MESSAGE_RESERVE_SIZE);
+                    }
+
+                    isAffinityRequested_ = false;
+                    affinityApplied_.notify_all();
                 }
             }
         }
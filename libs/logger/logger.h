@@ -1,41 +1,283 @@
 #pragma once
 
 #include <memory>
+#include <memory_resource>
+#include <array>
 #include <atomic>
-#include <queue>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-#define LOG(message) libs::logger::Logger::instance()->signalToLog(message)
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR 4
+
+// Levels below LOG_MIN_LEVEL are compiled out, their arguments are never evaluated
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define LOG_AT_LEVEL(level, ...)                                                \
+    do                                                                          \
+    {                                                                           \
+        if (libs::logger::Logger::isEnabled(level))                             \
+            libs::logger::Logger::instance()->signalToLog(level, __VA_ARGS__); \
+    } while (0)
+
+// Arguments stay referenced (and type-checked), so compiling a level out doesn't
+// leave variables unused, but they are never evaluated
+#define LOG_DISABLED(...)                                                                           \
+    do                                                                                              \
+    {                                                                                               \
+        if (false)                                                                                  \
+            libs::logger::Logger::instance()->signalToLog(libs::logger::Level::Trace, __VA_ARGS__); \
+    } while (0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT_LEVEL(libs::logger::Level::Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT_LEVEL(libs::logger::Level::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT_LEVEL(libs::logger::Level::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) LOG_AT_LEVEL(libs::logger::Level::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT_LEVEL(libs::logger::Level::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#define LOG(message) LOG_INFO("{}", message)
+
+#define LOG_QUEUE_SIZE 1024
+// Fits the largest message the network library passes (a 2048-byte datagram)
+// together with the arguments tuple, so logging it doesn't touch the heap
+#define LOG_RECORD_BUFFER_SIZE (2048 + 256)
 
 namespace libs
 {
     namespace logger
     {
+        enum class Level
+        {
+            Trace = LOG_LEVEL_TRACE,
+            Debug = LOG_LEVEL_DEBUG,
+            Info = LOG_LEVEL_INFO,
+            Warning = LOG_LEVEL_WARNING,
+            Error = LOG_LEVEL_ERROR
+        };
+
+        namespace details
+        {
+            void appendArgument(std::string &out, std::string_view value);
+            void appendArgument(std::string &out, char value);
+            void appendArgument(std::string &out, bool value);
+            void appendArgument(std::string &out, long long value);
+            void appendArgument(std::string &out, unsigned long long value);
+            void appendArgument(std::string &out, double value);
+            void appendArgument(std::string &out, const void *value);
+
+            template <typename T>
+            void appendArgument(std::string &out, const T &value)
+                requires std::is_integral_v<T>
+            {
+                if constexpr (std::is_signed_v<T>)
+                    appendArgument(out, static_cast<long long>(value));
+                else
+                    appendArgument(out, static_cast<unsigned long long>(value));
+            }
+
+            template <typename T>
+            void appendArgument(std::string &out, const T &value)
+                requires std::is_floating_point_v<T>
+            {
+                appendArgument(out, static_cast<double>(value));
+            }
+
+            // Replaces "{}" placeholders in order, "{{" and "}}" are escapes
+            bool nextPlaceholder(std::string &out, std::string_view &format);
+
+            template <typename... Args>
+            void format(std::string &out, std::string_view format, const Args &...args)
+            {
+                ((nextPlaceholder(out, format) ? appendArgument(out, args) : void()), ...);
+
+                // Placeholders without arguments are kept as is
+                while (nextPlaceholder(out, format))
+                    out.append("{}");
+            }
+
+            consteval std::size_t countPlaceholders(std::string_view format)
+            {
+                std::size_t count = 0;
+                for (std::size_t i = 0; i < format.size(); ++i)
+                {
+                    const char kNext = i + 1 < format.size() ? format[i + 1] : '\0';
+                    if (format[i] == '{' && kNext == '}')
+                        ++count;
+
+                    if ((format[i] == '{' || format[i] == '}') && (kNext == '}' || kNext == format[i]))
+                        ++i;
+                }
+
+                return count;
+            }
+
+            // Format is kept by reference until the message is written on the logger
+            // thread, so only string literals are accepted. The number of "{}" has to
+            // match the arguments, a mismatch doesn't compile
+            template <typename... Args>
+            class FormatString
+            {
+            public:
+                template <std::size_t N>
+                consteval FormatString(const char (&literal)[N]) : value_(literal, N - 1)
+                {
+                    if (countPlaceholders(value_) != sizeof...(Args))
+                        throw "Number of {} placeholders doesn't match the number of arguments";
+                }
+
+                std::string_view value() const
+                {
+                    return value_;
+                }
+
+            private:
+                std::string_view value_;
+            };
+
+            // Text arguments are copied into the record arena, because the message is
+            // formatted later on the logger thread
+            template <typename T>
+            using Stored = std::conditional_t<
+                std::is_convertible_v<const std::decay_t<T> &, std::string_view> &&
+                    !std::is_same_v<std::decay_t<T>, std::nullptr_t>,
+                std::pmr::string,
+                std::decay_t<T>>;
+        }
+
         class Logger
         {
         public:
             static std::shared_ptr<Logger> instance();
 
+            static bool isEnabled(Level level)
+            {
+                return static_cast<int>(level) >= minLevel_.load(std::memory_order_relaxed);
+            }
+            static void setLevel(Level level);
+
             bool init(const std::string &filePath);
-            void signalToLog(const std::string &message);
+
+            // Pins the worker thread to the CPUs and moves its buffers to their NUMA node
+            bool setCpuAffinity(const std::vector<int> &cpus);
+
+            // Arguments are stored in a preallocated record, so steady-state logging
+            // doesn't touch the heap unless they overflow LOG_RECORD_BUFFER_SIZE
+            template <typename... Args>
+            void signalToLog(Level level, details::FormatString<std::type_identity_t<Args>...> format, Args &&...args)
+            {
+                using Arguments = std::tuple<details::Stored<Args>...>;
+
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex_);
+                    notFull_.wait(lock, [this]
+                                  { return queueSize_ < LOG_QUEUE_SIZE; });
+
+                    Record &record = records_[(queueHead_ + queueSize_) % LOG_QUEUE_SIZE];
+                    std::pmr::polymorphic_allocator<> allocator(&record.arena_);
+
+                    record.level_ = level;
+                    record.format_ = format.value();
+                    record.arguments_ = allocator.new_object<Arguments>(std::forward<Args>(args)...);
+                    record.formatArguments_ = &formatArguments<Arguments>;
+                    record.destroyArguments_ = &destroyArguments<Arguments>;
+
+                    ++queueSize_;
+                }
+                condition_.notify_one();
+            }
 
             ~Logger();
             Logger(Logger &other) = delete;
             void operator=(const Logger &) = delete;
 
         private:
+            struct Record
+            {
+                Level level_{Level::Info};
+                std::string_view format_;
+                void *arguments_{nullptr};
+                void (*formatArguments_)(std::string &, std::string_view, void *){nullptr};
+                void (*destroyArguments_)(void *){nullptr};
+
+                alignas(std::max_align_t) std::array<std::byte, LOG_RECORD_BUFFER_SIZE> buffer_;
+                std::pmr::monotonic_buffer_resource arena_{buffer_.data(), buffer_.size()};
+            };
+
+            template <typename Arguments>
+            static void formatArguments(std::string &out, std::string_view format, void *arguments)
+            {
+                std::apply([&](const auto &...values)
+                           { details::format(out, format, values...); },
+                           *static_cast<Arguments *>(arguments));
+            }
+
+            template <typename Arguments>
+            static void destroyArguments(void *arguments)
+            {
+                static_cast<Arguments *>(arguments)->~Arguments();
+            }
+
             Logger();
             void doLog();
 
+            static std::atomic<int> minLevel_;
+
             std::string filePath_;
+            std::atomic<int> fileFD_{-1};
             std::atomic<bool> running_;
-            std::queue<std::string> messageQueue_;
+            std::unique_ptr<Record[]> records_;
+            std::size_t queueHead_{0};
+            std::size_t queueSize_{0};
             std::thread workerThread_;
             std::mutex queueMutex_;
             std::condition_variable condition_;
+            std::condition_variable notFull_;
+
+            std::vector<int> requestedCpus_;
+            bool isAffinityRequested_{false};
+            bool isAffinitySet_{false};
+            std::condition_variable affinityApplied_;
         };
     }
-}
\ No newline at end of file
+}
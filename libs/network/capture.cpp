@@ -0,0 +1,235 @@
+#include "capture.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+
+#define CAPTURE_GROW_SIZE (64 * 1024 * 1024)
+
+namespace
+{
+    std::size_t alignRecord(std::size_t size)
+    {
+        return (size + 7) & ~std::size_t(7);
+    }
+
+    std::uint64_t nowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+}
+
+namespace libs
+{
+    namespace network
+    {
+        namespace capture
+        {
+            Writer::~Writer()
+            {
+                close();
+            }
+
+            bool Writer::open(const std::string &filePath, Transport transport)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                fd_ = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd_ == -1)
+                    return false;
+
+                size_ = 0;
+                if (!grow(sizeof(FileHeader)))
+                {
+                    ::close(fd_);
+                    fd_ = -1;
+                    return false;
+                }
+
+                FileHeader header;
+                header.transport_ = static_cast<std::uint32_t>(transport);
+                memcpy(data_, &header, sizeof(header));
+                size_ = sizeof(header);
+
+                startNanoseconds_ = nowNanoseconds();
+                return true;
+            }
+
+            bool Writer::close()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                bool isTruncated = true;
+
+                if (data_)
+                    munmap(data_, capacity_);
+
+                if (fd_ != -1)
+                {
+                    // Cut the preallocated tail
+                    isTruncated = ftruncate(fd_, size_) == 0;
+                    ::close(fd_);
+                }
+
+                fd_ = -1;
+                data_ = nullptr;
+                capacity_ = 0;
+                size_ = 0;
+
+                return isTruncated;
+            }
+
+            bool Writer::append(ConnectionId connectionId, std::string_view payload)
+            {
+                if (payload.empty())
+                    return true;
+
+                return appendRecord(connectionId, RecordKind::Data, payload);
+            }
+
+            bool Writer::appendClose(ConnectionId connectionId)
+            {
+                return appendRecord(connectionId, RecordKind::Close, {});
+            }
+
+            bool Writer::appendRecord(ConnectionId connectionId, RecordKind kind, std::string_view payload)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (!data_)
+                    return false;
+
+                const std::size_t kRecordSize = sizeof(RecordHeader) + alignRecord(payload.size());
+                if (size_ + kRecordSize > capacity_ && !grow(size_ + kRecordSize))
+                    return false;
+
+                RecordHeader header;
+                header.timestampNanoseconds_ = nowNanoseconds() - startNanoseconds_;
+                header.connectionId_ = connectionId;
+                header.size_ = payload.size();
+                header.kind_ = kind;
+
+                memcpy(data_ + size_, &header, sizeof(header));
+                memcpy(data_ + size_ + sizeof(header), payload.data(), payload.size());
+                size_ += kRecordSize;
+
+                return true;
+            }
+
+            bool Writer::grow(std::size_t required)
+            {
+                std::size_t capacity = capacity_;
+                while (capacity < required)
+                    capacity += CAPTURE_GROW_SIZE;
+
+                if (ftruncate(fd_, capacity) == -1)
+                    return false;
+
+                void *data = data_ ? mremap(data_, capacity_, capacity, MREMAP_MAYMOVE)
+                                   : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+                if (data == MAP_FAILED)
+                    return false;
+
+                data_ = static_cast<char *>(data);
+                capacity_ = capacity;
+                return true;
+            }
+
+            Reader::~Reader()
+            {
+                close();
+            }
+
+            bool Reader::open(const std::string &filePath)
+            {
+                close();
+
+                fd_ = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd_ == -1)
+                    return false;
+
+                struct stat info;
+                if (fstat(fd_, &info) == -1 || static_cast<std::size_t>(info.st_size) < sizeof(FileHeader))
+                {
+                    close();
+                    return false;
+                }
+
+                size_ = info.st_size;
+                void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+                if (data == MAP_FAILED)
+                {
+                    data_ = nullptr;
+                    close();
+                    return false;
+                }
+                data_ = static_cast<const char *>(data);
+                madvise(const_cast<char *>(data_), size_, MADV_SEQUENTIAL);
+
+                FileHeader header;
+                memcpy(&header, data_, sizeof(header));
+                // Version 1 has no close records, otherwise the same
+                if (header.magic_ != kMagic || header.version_ == 0 || header.version_ > kVersion)
+                {
+                    close();
+                    return false;
+                }
+
+                transport_ = static_cast<Transport>(header.transport_);
+                position_ = sizeof(FileHeader);
+                return true;
+            }
+
+            void Reader::close()
+            {
+                if (data_)
+                    munmap(const_cast<char *>(data_), size_);
+
+                if (fd_ != -1)
+                    ::close(fd_);
+
+                fd_ = -1;
+                data_ = nullptr;
+                size_ = 0;
+                position_ = 0;
+            }
+
+            Transport Reader::transport() const
+            {
+                return transport_;
+            }
+
+            bool Reader::next(Record &record)
+            {
+                if (!data_ || position_ + sizeof(RecordHeader) > size_)
+                    return false;
+
+                RecordHeader header;
+                memcpy(&header, data_ + position_, sizeof(header));
+
+                if ((header.kind_ == RecordKind::Data && header.size_ == 0) ||
+                    (header.kind_ != RecordKind::Data && header.kind_ != RecordKind::Close) ||
+                    position_ + sizeof(header) + header.size_ > size_)
+                    return false;
+
+                record.timestampNanoseconds_ = header.timestampNanoseconds_;
+                record.connectionId_ = header.connectionId_;
+                record.kind_ = header.kind_;
+                record.payload_ = std::string_view(data_ + position_ + sizeof(header), header.size_);
+
+                position_ += sizeof(header) + alignRecord(header.size_);
+                return true;
+            }
+
+            void Reader::rewind()
+            {
+                position_ = sizeof(FileHeader);
+            }
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "network.h"
+
+namespace libs
+{
+    namespace network
+    {
+        // Capture file: FileHeader followed by records, each one is RecordHeader
+        // and the payload padded to 8 bytes. Data record with zero size ends the file
+        namespace capture
+        {
+            constexpr std::uint32_t kMagic{0x50434e53}; // "SNCP"
+            constexpr std::uint32_t kVersion{2}; // 2 - close records
+
+            enum class RecordKind : std::uint32_t
+            {
+                Data,
+                Close // connection was closed by either side, no payload
+            };
+
+            struct FileHeader
+            {
+                std::uint32_t magic_{kMagic};
+                std::uint32_t version_{kVersion};
+                std::uint32_t transport_{0}; // Transport as int
+                std::uint32_t reserved_{0};
+            };
+
+            struct RecordHeader
+            {
+                std::uint64_t timestampNanoseconds_{0}; // since capture start
+                ConnectionId connectionId_{0};
+                std::uint32_t size_{0};
+                RecordKind kind_{RecordKind::Data};
+            };
+
+            struct Record
+            {
+                std::uint64_t timestampNanoseconds_{0};
+                ConnectionId connectionId_{0};
+                RecordKind kind_{RecordKind::Data};
+                std::string_view payload_;
+            };
+
+            // Appends records to a memory-mapped file, growing it in chunks.
+            // Thread-safe, records are ordered by timestamp
+            class Writer
+            {
+            public:
+                Writer() = default;
+                ~Writer();
+
+                Writer(const Writer &) = delete;
+                Writer &operator=(const Writer &) = delete;
+
+                bool open(const std::string &filePath, Transport transport);
+                bool close();
+
+                bool append(ConnectionId connectionId, std::string_view payload);
+                bool appendClose(ConnectionId connectionId);
+
+            private:
+                bool appendRecord(ConnectionId connectionId, RecordKind kind, std::string_view payload);
+                bool grow(std::size_t required);
+
+                std::mutex mutex_;
+                int fd_{-1};
+                char *data_{nullptr};
+                std::size_t capacity_{0};
+                std::size_t size_{0};
+                std::uint64_t startNanoseconds_{0};
+            };
+
+            class Reader
+            {
+            public:
+                Reader() = default;
+                ~Reader();
+
+                Reader(const Reader &) = delete;
+                Reader &operator=(const Reader &) = delete;
+
+                bool open(const std::string &filePath);
+                void close();
+
+                Transport transport() const;
+
+                // Returns false at the end of file or on a malformed record
+                bool next(Record &record);
+                void rewind();
+
+            private:
+                int fd_{-1};
+                const char *data_{nullptr};
+                std::size_t size_{0};
+                std::size_t position_{0};
+                Transport transport_{Transport::Tcp};
+            };
+        }
+    }
+}
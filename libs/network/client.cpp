@@ -1,12 +1,27 @@
 #include "network.h"
+#include "output_queue.h"
+#include "datagram.h"
+#include "log.h"
 
 #include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <csignal>
 #include <cstring>
+#include <algorithm>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 #include <iomanip>
+#include <sstream>
 #include <string>
 
+#define WRITE_QUANTUM_SIZE (64 * 1024)
+#define POLL_INTERVAL_MILLISECONDS 100
+#define PIPE_STALL_TIMEOUT_MILLISECONDS 5000
+
 namespace
 {
     std::string getCurrentTime()
@@ -31,7 +46,7 @@ namespace libs
             {
             public:
                 ClientImpl() = delete;
-                ClientImpl(std::function<void(const std::string &)> logCallback) : logCallback_(logCallback)
+                ClientImpl(LogCallback logCallback) : log_(std::move(logCallback))
                 {
                 }
                 ~ClientImpl()
@@ -43,14 +58,25 @@ namespace libs
                 {
                     if (isRunning_.load())
                     {
-                        logCallback_("Client already started");
+                        log_(LogLevel::Warning, "Client already started");
                         return false;
                     }
 
                     config_ = config;
+                    transport_.store(config_.transport_);
+                    {
+                        std::lock_guard<std::mutex> lock(datagramsMutex_);
+                        datagramBatchSize_ = config_.datagramBatchSize_;
+                    }
+                    log_.setLevel(config_.logLevel_);
+
+                    signal(SIGPIPE, SIG_IGN);
 
                     isRunning_.store(true);
 
+                    if (config_.transport_ == Transport::Udp)
+                        return runDatagrams();
+
                     while (isRunning_.load())
                     {
                         if (createAndConnect())
@@ -69,15 +95,148 @@ namespace libs
                         return;
 
                     isRunning_.store(false);
+                    datagramsCondition_.notify_all();
+                }
+
+                bool send(const std::string &message)
+                {
+                    // config_ belongs to the thread running start(), send() uses copies
+                    if (transport_.load() == Transport::Udp)
+                    {
+                        queueDatagram(message);
+                        return true;
+                    }
+
+                    std::lock_guard<std::mutex> lock(outputMutex_);
+                    output_.pushBuffer(message);
+                    return true;
+                }
+
+                DatagramCounters datagramCounters() const
+                {
+                    DatagramCounters counters;
+                    counters.datagrams_ = datagramsSent_.load(std::memory_order_relaxed);
+                    counters.dropped_ = datagramsDropped_.load(std::memory_order_relaxed);
+                    return counters;
+                }
+
+                bool sendFile(int fileFD, off_t offset, std::size_t count)
+                {
+                    // Datagrams carry only messages, the stream queue is never flushed there
+                    if (transport_.load() == Transport::Udp)
+                        return false;
+
+                    const int kFD = dup(fileFD);
+                    if (kFD == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to duplicate file descriptor");
+                        return false;
+                    }
+
+                    std::lock_guard<std::mutex> lock(outputMutex_);
+                    output_.pushFile(kFD, offset, count);
+                    return true;
+                }
+
+                bool sendPipe(int pipeFD, std::size_t count)
+                {
+                    if (transport_.load() == Transport::Udp)
+                        return false;
+
+                    const int kFD = dup(pipeFD);
+                    if (kFD == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to duplicate pipe descriptor");
+                        return false;
+                    }
+
+                    std::lock_guard<std::mutex> lock(outputMutex_);
+                    output_.pushPipe(kFD, count);
+                    return true;
                 }
 
             private:
+                // Connected datagram socket: no handshake, no reconnects
+                bool runDatagrams()
+                {
+                    if (!createAndConnect())
+                    {
+                        closeConnection();
+                        isRunning_.store(false);
+                        return false;
+                    }
+
+                    const auto kInterval = std::chrono::seconds(config_.reconnectingTimeoutSeconds_);
+                    auto nextMessageTime = std::chrono::steady_clock::now();
+
+                    while (isRunning_.load())
+                    {
+                        if (std::chrono::steady_clock::now() >= nextMessageTime)
+                        {
+                            queueDatagram(makeMessage());
+                            nextMessageTime += kInterval;
+                        }
+
+                        {
+                            std::unique_lock<std::mutex> lock(datagramsMutex_);
+                            datagramsCondition_.wait_until(lock, nextMessageTime, [this]
+                                                           { return datagrams_.size() >= datagramBatchSize_ || !isRunning_.load(); });
+                        }
+
+                        flushDatagrams();
+                    }
+
+                    flushDatagrams();
+                    closeConnection();
+                    return true;
+                }
+
+                void queueDatagram(std::string datagram)
+                {
+                    bool isBatchFull = false;
+                    {
+                        std::lock_guard<std::mutex> lock(datagramsMutex_);
+                        datagrams_.push_back(std::move(datagram));
+                        isBatchFull = datagrams_.size() >= datagramBatchSize_;
+                    }
+
+                    if (isBatchFull)
+                        datagramsCondition_.notify_one();
+                }
+
+                void flushDatagrams()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(datagramsMutex_);
+                        sendingDatagrams_.swap(datagrams_);
+                    }
+
+                    if (sendingDatagrams_.empty())
+                        return;
+
+                    const DatagramSendResult kResult = sendDatagrams(clientSocketFD_, sendingDatagrams_);
+                    datagramsSent_.fetch_add(kResult.sent_, std::memory_order_relaxed);
+                    datagramsDropped_.fetch_add(kResult.dropped_, std::memory_order_relaxed);
+
+                    if (kResult.dropped_ != 0)
+                        log_(LogLevel::Warning, "Datagrams dropped: ", kResult.dropped_);
+                    else
+                        log_(LogLevel::Debug, "Datagrams sent: ", kResult.sent_);
+
+                    sendingDatagrams_.clear();
+                }
+
+                std::string makeMessage() const
+                {
+                    return "[" + getCurrentTime() + "] \"" + config_.title_ + "\"";
+                }
+
                 bool createAndConnect()
                 {
-                    clientSocketFD_ = socket(AF_INET, SOCK_STREAM, 0);
+                    clientSocketFD_ = socket(AF_INET, config_.transport_ == Transport::Udp ? SOCK_DGRAM : SOCK_STREAM, 0);
                     if (clientSocketFD_ == -1)
                     {
-                        logCallback_("Failed to create socket");
+                        log_(LogLevel::Error, "Failed to create socket");
                         return false;
                     }
 
@@ -88,13 +247,13 @@ namespace libs
 
                     if (inet_pton(AF_INET, config_.address_.c_str(), &server_addr.sin_addr) <= 0)
                     {
-                        logCallback_("Failed to bind to address");
+                        log_(LogLevel::Error, "Failed to bind to address");
                         return false;
                     }
 
                     if (connect(clientSocketFD_, (sockaddr *)&server_addr, sizeof(server_addr)) == -1)
                     {
-                        logCallback_("Failed to connect");
+                        log_(LogLevel::Warning, "Failed to connect");
                         return false;
                     }
 
@@ -103,14 +262,70 @@ namespace libs
 
                 void communicateWithServer()
                 {
-                    const std::string kMessage("[" + getCurrentTime() + "] \"" + config_.title_ + "\"");
+                    const std::string kMessage(makeMessage());
 
-                    if (send(clientSocketFD_, kMessage.c_str(), kMessage.size(), 0) == -1)
+                    if (::send(clientSocketFD_, kMessage.c_str(), kMessage.size(), 0) == -1)
                     {
-                        logCallback_("Failed to send to server");
+                        log_(LogLevel::Error, "Failed to send to server");
                     }
 
-                    logCallback_("Message sent: " + kMessage);
+                    log_(LogLevel::Info, "Message sent: ", kMessage);
+
+                    flushOutput();
+                }
+
+                // The lock is taken per quantum, so send() isn't blocked by a long transfer
+                void flushOutput()
+                {
+                    auto stalledSince = std::chrono::steady_clock::time_point::max();
+
+                    while (isRunning_.load())
+                    {
+                        OutputQueue::FlushResult result;
+                        int stalledPipeFD = kIncorrectSocketValue_;
+                        {
+                            std::lock_guard<std::mutex> lock(outputMutex_);
+                            result = output_.flush(clientSocketFD_, WRITE_QUANTUM_SIZE);
+
+                            if (result == OutputQueue::FlushResult::Error)
+                                output_.dropPartial();
+                            else if (result == OutputQueue::FlushResult::Stalled)
+                                stalledPipeFD = output_.stalledPipeFD();
+                        }
+
+                        // Only this thread pops chunks, so the pipe stays open without the lock
+                        pollfd pfd{clientSocketFD_, POLLOUT, 0};
+                        switch (result)
+                        {
+                        case OutputQueue::FlushResult::Done:
+                            return;
+                        case OutputQueue::FlushResult::Pending:
+                            stalledSince = std::chrono::steady_clock::time_point::max();
+                            continue;
+                        case OutputQueue::FlushResult::WouldBlock:
+                            break;
+                        case OutputQueue::FlushResult::Stalled:
+                            stalledSince = std::min(stalledSince, std::chrono::steady_clock::now());
+                            if (std::chrono::steady_clock::now() - stalledSince >= std::chrono::milliseconds(PIPE_STALL_TIMEOUT_MILLISECONDS))
+                            {
+                                log_(LogLevel::Warning, "Queued pipe has no data, dropped");
+
+                                std::lock_guard<std::mutex> lock(outputMutex_);
+                                output_.dropFront();
+                                stalledSince = std::chrono::steady_clock::time_point::max();
+                                continue;
+                            }
+
+                            pfd = {stalledPipeFD, POLLIN, 0};
+                            break;
+                        case OutputQueue::FlushResult::Error:
+                            log_(LogLevel::Error, "Failed to send queued data to server");
+                            return;
+                        }
+
+                        // Short waits, so stop() is noticed
+                        poll(&pfd, 1, POLL_INTERVAL_MILLISECONDS);
+                    }
                 }
 
                 void closeConnection()
@@ -127,12 +342,28 @@ namespace libs
                 const int kIncorrectSocketValue_{-1};
                 int clientSocketFD_{kIncorrectSocketValue_};
 
-                std::function<void(const std::string &)> logCallback_;
+                Log log_;
+
+                std::mutex outputMutex_;
+                OutputQueue output_;
+
+                std::mutex datagramsMutex_;
+                std::condition_variable datagramsCondition_;
+                std::vector<std::string> datagrams_;
+                std::vector<std::string> sendingDatagrams_;
+                std::size_t datagramBatchSize_{0};
+                std::atomic<std::uint64_t> datagramsSent_{0};
+                std::atomic<std::uint64_t> datagramsDropped_{0};
 
+                std::atomic<Transport> transport_{Transport::Tcp};
                 std::atomic<bool> isRunning_{false};
             };
 
-            Client::Client(std::function<void(const std::string &)> logCallback) : clientImpl_(std::make_unique<Client::ClientImpl>(logCallback)) {}
+            Client::Client(std::function<void(std::string_view)> logCallback)
+                : Client(LogCallback([logCallback](LogLevel, std::string_view message)
+                                     { logCallback(message); })) {}
+
+            Client::Client(LogCallback logCallback) : clientImpl_(std::make_unique<Client::ClientImpl>(std::move(logCallback))) {}
 
             Client::~Client()
             {
@@ -154,6 +385,38 @@ namespace libs
 
                 return clientImpl_->stop();
             }
+
+            bool Client::send(const std::string &message)
+            {
+                if (!clientImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return clientImpl_->send(message);
+            }
+
+            DatagramCounters Client::datagramCounters() const
+            {
+                if (!clientImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return clientImpl_->datagramCounters();
+            }
+
+            bool Client::sendFile(int fileFD, off_t offset, std::size_t count)
+            {
+                if (!clientImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return clientImpl_->sendFile(fileFD, offset, count);
+            }
+
+            bool Client::sendPipe(int pipeFD, std::size_t count)
+            {
+                if (!clientImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return clientImpl_->sendPipe(pipeFD, count);
+            }
         }
     }
 }
\ No newline at end of file
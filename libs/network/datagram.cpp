@@ -0,0 +1,134 @@
+#include "datagram.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#define DATAGRAM_CONTROL_SIZE CMSG_SPACE(sizeof(std::uint32_t))
+#define DATAGRAM_SEND_BATCH_SIZE 64
+
+namespace libs
+{
+    namespace network
+    {
+        DatagramReceiver::DatagramReceiver(std::size_t batchSize, std::size_t datagramSize)
+            : datagramSize_(datagramSize),
+              buffers_(batchSize * datagramSize),
+              controls_(batchSize * DATAGRAM_CONTROL_SIZE),
+              iovecs_(batchSize),
+              addresses_(batchSize),
+              messages_(batchSize)
+        {
+        }
+
+        int DatagramReceiver::receive(int socketFD)
+        {
+            for (std::size_t i = 0; i < messages_.size(); ++i)
+            {
+                iovecs_[i].iov_base = buffers_.data() + i * datagramSize_;
+                iovecs_[i].iov_len = datagramSize_;
+
+                memset(&messages_[i], 0, sizeof(mmsghdr));
+                messages_[i].msg_hdr.msg_name = &addresses_[i];
+                messages_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+                messages_[i].msg_hdr.msg_iovlen = 1;
+                messages_[i].msg_hdr.msg_control = controls_.data() + i * DATAGRAM_CONTROL_SIZE;
+                messages_[i].msg_hdr.msg_controllen = DATAGRAM_CONTROL_SIZE;
+            }
+
+            int count = -1;
+            do
+            {
+                count = recvmmsg(socketFD, messages_.data(), messages_.size(), MSG_DONTWAIT, nullptr);
+            } while (count == -1 && errno == EINTR);
+
+            if (count == -1)
+                return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+            for (int i = 0; i < count; ++i)
+            {
+                msghdr &header = messages_[i].msg_hdr;
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg))
+                {
+                    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SO_RXQ_OVFL)
+                        continue;
+
+                    std::uint32_t dropped = 0;
+                    memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                    kernelDropped_ = std::max(kernelDropped_, dropped);
+                }
+            }
+
+            return count;
+        }
+
+        std::string_view DatagramReceiver::datagram(int index) const
+        {
+            return std::string_view(buffers_.data() + index * datagramSize_,
+                                    std::min<std::size_t>(messages_[index].msg_len, datagramSize_));
+        }
+
+        bool DatagramReceiver::isTruncated(int index) const
+        {
+            return messages_[index].msg_hdr.msg_flags & MSG_TRUNC;
+        }
+
+        std::uint64_t DatagramReceiver::source(int index) const
+        {
+            return (std::uint64_t(ntohl(addresses_[index].sin_addr.s_addr)) << 16) | ntohs(addresses_[index].sin_port);
+        }
+
+        std::uint32_t DatagramReceiver::kernelDropped() const
+        {
+            return kernelDropped_;
+        }
+
+        std::size_t DatagramReceiver::batchSize() const
+        {
+            return messages_.size();
+        }
+
+        DatagramSendResult sendDatagrams(int socketFD, const std::vector<std::string> &datagrams)
+        {
+            DatagramSendResult result;
+
+            iovec iovecs[DATAGRAM_SEND_BATCH_SIZE];
+            mmsghdr messages[DATAGRAM_SEND_BATCH_SIZE];
+
+            std::size_t position = 0;
+            while (position < datagrams.size())
+            {
+                const std::size_t kCount = std::min<std::size_t>(DATAGRAM_SEND_BATCH_SIZE, datagrams.size() - position);
+                for (std::size_t i = 0; i < kCount; ++i)
+                {
+                    const std::string &datagram = datagrams[position + i];
+                    iovecs[i].iov_base = const_cast<char *>(datagram.data());
+                    iovecs[i].iov_len = datagram.size();
+
+                    memset(&messages[i], 0, sizeof(mmsghdr));
+                    messages[i].msg_hdr.msg_iov = &iovecs[i];
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                }
+
+                const int kSent = sendmmsg(socketFD, messages, kCount, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (kSent == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    // First datagram of the batch is refused (full buffer, ICMP error), skip it
+                    ++result.dropped_;
+                    ++position;
+                    continue;
+                }
+
+                result.sent_ += kSent;
+                position += kSent;
+            }
+
+            return result;
+        }
+    }
+}
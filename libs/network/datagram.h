@@ -0,0 +1,59 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace libs
+{
+    namespace network
+    {
+        // Receives up to `batchSize` datagrams per recvmmsg(2) into buffers
+        // allocated once in the constructor
+        class DatagramReceiver
+        {
+        public:
+            DatagramReceiver(std::size_t batchSize, std::size_t datagramSize);
+
+            DatagramReceiver(const DatagramReceiver &) = delete;
+            DatagramReceiver &operator=(const DatagramReceiver &) = delete;
+
+            // Returns number of received datagrams, 0 if there is nothing to read, -1 on error
+            int receive(int socketFD);
+
+            std::string_view datagram(int index) const;
+            bool isTruncated(int index) const;
+
+            // Sender address packed as (IPv4 << 16 | port)
+            std::uint64_t source(int index) const;
+
+            // Cumulative count of datagrams dropped by the kernel (SO_RXQ_OVFL)
+            std::uint32_t kernelDropped() const;
+
+            std::size_t batchSize() const;
+
+        private:
+            std::size_t datagramSize_;
+            std::vector<char> buffers_;
+            std::vector<char> controls_;
+            std::vector<iovec> iovecs_;
+            std::vector<sockaddr_in> addresses_;
+            std::vector<mmsghdr> messages_;
+            std::uint32_t kernelDropped_{0};
+        };
+
+        struct DatagramSendResult
+        {
+            std::size_t sent_{0};
+            std::size_t dropped_{0};
+        };
+
+        // Sends the datagrams with as few sendmmsg(2) calls as possible.
+        // Datagrams the kernel refuses are dropped, not retried
+        DatagramSendResult sendDatagrams(int socketFD, const std::vector<std::string> &datagrams);
+    }
+}
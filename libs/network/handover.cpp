@@ -0,0 +1,215 @@
+#include "handover.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+    bool fillAddress(const std::string &path, sockaddr_un &address)
+    {
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+            return false;
+
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    bool sendPacket(int socketFD, const void *data, std::size_t size, const int *fds, std::size_t fdsCount)
+    {
+        iovec iov;
+        iov.iov_base = const_cast<void *>(data);
+        iov.iov_len = size;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * libs::network::handover::kMaxDescriptorsPerPacket)];
+        memset(control, 0, sizeof(control));
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        if (fdsCount > 0)
+        {
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * fdsCount);
+
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdsCount);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdsCount);
+        }
+
+        ssize_t sent = -1;
+        do
+        {
+            sent = sendmsg(socketFD, &message, MSG_NOSIGNAL);
+        } while (sent == -1 && errno == EINTR);
+
+        return sent == static_cast<ssize_t>(size);
+    }
+
+    ssize_t receivePacket(int socketFD, void *data, std::size_t size, std::vector<int> &fds)
+    {
+        iovec iov;
+        iov.iov_base = data;
+        iov.iov_len = size;
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * libs::network::handover::kMaxDescriptorsPerPacket)];
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = -1;
+        do
+        {
+            received = recvmsg(socketFD, &message, MSG_CMSG_CLOEXEC);
+        } while (received == -1 && errno == EINTR);
+
+        if (received == -1)
+            return -1;
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            const std::size_t kCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const std::size_t kOffset = fds.size();
+            fds.resize(kOffset + kCount);
+            memcpy(fds.data() + kOffset, CMSG_DATA(cmsg), sizeof(int) * kCount);
+        }
+
+        if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+            return -1;
+
+        return received;
+    }
+}
+
+namespace libs
+{
+    namespace network
+    {
+        namespace handover
+        {
+            int createListener(const std::string &path)
+            {
+                sockaddr_un address;
+                if (!fillAddress(path, address))
+                    return -1;
+
+                int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+                if (fd == -1)
+                    return -1;
+
+                unlink(path.c_str());
+
+                if (bind(fd, (sockaddr *)&address, sizeof(address)) == -1 ||
+                    listen(fd, 1) == -1)
+                {
+                    close(fd);
+                    return -1;
+                }
+
+                return fd;
+            }
+
+            int connectTo(const std::string &path)
+            {
+                sockaddr_un address;
+                if (!fillAddress(path, address))
+                    return -1;
+
+                int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+                if (fd == -1)
+                    return -1;
+
+                if (connect(fd, (sockaddr *)&address, sizeof(address)) == -1)
+                {
+                    close(fd);
+                    return -1;
+                }
+
+                return fd;
+            }
+
+            bool send(int socketFD, const Header &header, int listenerFD,
+                      const std::vector<Connection> &connections)
+            {
+                if (!sendPacket(socketFD, &header, sizeof(header), &listenerFD, 1))
+                    return false;
+
+                ConnectionId ids[kMaxDescriptorsPerPacket];
+                int fds[kMaxDescriptorsPerPacket];
+
+                for (std::size_t i = 0; i < connections.size(); i += kMaxDescriptorsPerPacket)
+                {
+                    const std::size_t kCount = std::min(kMaxDescriptorsPerPacket, connections.size() - i);
+                    for (std::size_t j = 0; j < kCount; ++j)
+                    {
+                        ids[j] = connections[i + j].id_;
+                        fds[j] = connections[i + j].fd_;
+                    }
+
+                    if (!sendPacket(socketFD, ids, sizeof(ConnectionId) * kCount, fds, kCount))
+                        return false;
+                }
+
+                return true;
+            }
+
+            bool receive(int socketFD, Header &header, int &listenerFD,
+                         std::vector<Connection> &connections)
+            {
+                std::vector<int> fds;
+
+                auto closeAll = [&]()
+                {
+                    for (const int kFD : fds)
+                        close(kFD);
+                    return false;
+                };
+
+                if (receivePacket(socketFD, &header, sizeof(header), fds) != sizeof(header) ||
+                    header.magic_ != kMagic || header.version_ != kVersion || fds.size() != 1)
+                    return closeAll();
+
+                listenerFD = fds.front();
+
+                ConnectionId ids[kMaxDescriptorsPerPacket];
+                while (connections.size() < header.connectionsCount_)
+                {
+                    fds.clear();
+
+                    const ssize_t kReceived = receivePacket(socketFD, ids, sizeof(ids), fds);
+                    if (kReceived <= 0 || kReceived % sizeof(ConnectionId) != 0 ||
+                        fds.size() != kReceived / sizeof(ConnectionId))
+                    {
+                        closeAll();
+                        for (const auto &connection : connections)
+                            close(connection.fd_);
+                        close(listenerFD);
+                        connections.clear();
+                        return false;
+                    }
+
+                    for (std::size_t i = 0; i < fds.size(); ++i)
+                        connections.push_back({ids[i], fds[i]});
+                }
+
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "network.h"
+
+namespace libs
+{
+    namespace network
+    {
+        // Hot upgrade protocol over a SOCK_SEQPACKET unix socket. The first packet
+        // carries the header and the listening socket, the following ones carry
+        // connection ids with their sockets attached via SCM_RIGHTS
+        namespace handover
+        {
+            constexpr std::uint32_t kMagic{0x534e4855}; // "SNHU"
+            constexpr std::uint32_t kVersion{2};
+            constexpr std::size_t kMaxDescriptorsPerPacket{64};
+
+            struct Header
+            {
+                std::uint32_t magic_{kMagic};
+                std::uint32_t version_{kVersion};
+                std::uint64_t connectionsCount_{0};
+                ConnectionId nextConnectionId_{0};
+                Transport transport_{Transport::Tcp}; // of the listening socket
+            };
+
+            struct Connection
+            {
+                ConnectionId id_{0};
+                int fd_{-1};
+            };
+
+            int createListener(const std::string &path);
+            int connectTo(const std::string &path);
+
+            bool send(int socketFD, const Header &header, int listenerFD,
+                      const std::vector<Connection> &connections);
+
+            // On success the caller owns all received descriptors
+            bool receive(int socketFD, Header &header, int &listenerFD,
+                         std::vector<Connection> &connections);
+        }
+    }
+}
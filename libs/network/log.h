@@ -0,0 +1,73 @@
+#pragma once
+
+#include "network.h"
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace libs
+{
+    namespace network
+    {
+        // Level-aware wrapper over the user's log callback. A message made of several
+        // parts is only built if its level passes the threshold
+        class Log
+        {
+        public:
+            explicit Log(LogCallback callback) : callback_(std::move(callback)) {}
+
+            void setLevel(LogLevel level)
+            {
+                level_.store(level, std::memory_order_relaxed);
+            }
+
+            bool isEnabled(LogLevel level) const
+            {
+                return callback_ && level >= level_.load(std::memory_order_relaxed);
+            }
+
+            // Received data, passed regardless of the level: only diagnostics are filtered
+            void deliver(std::string_view message) const
+            {
+                if (callback_)
+                    callback_(LogLevel::Info, message);
+            }
+
+            void operator()(LogLevel level, std::string_view message) const
+            {
+                if (isEnabled(level))
+                    callback_(level, message);
+            }
+
+            template <typename... Parts>
+                requires(sizeof...(Parts) > 1)
+            void operator()(LogLevel level, const Parts &...parts) const
+            {
+                if (!isEnabled(level))
+                    return;
+
+                std::string message;
+                (append(message, parts), ...);
+                callback_(level, message);
+            }
+
+        private:
+            static void append(std::string &out, std::string_view part)
+            {
+                out.append(part);
+            }
+
+            template <typename T>
+                requires std::is_arithmetic_v<T>
+            static void append(std::string &out, T part)
+            {
+                out.append(std::to_string(part));
+            }
+
+            LogCallback callback_;
+            std::atomic<LogLevel> level_{LogLevel::Info};
+        };
+    }
+}
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <sys/types.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <memory>
 #include <functional>
 
@@ -8,6 +14,40 @@ namespace libs
 {
     namespace network
     {
+        using ConnectionId = std::uint64_t;
+
+        enum class LogLevel
+        {
+            Debug,
+            Info,
+            Warning,
+            Error
+        };
+
+        // Received messages are passed at Info level whatever the configured level is
+        using LogCallback = std::function<void(LogLevel, std::string_view)>;
+
+        enum class Transport
+        {
+            Tcp,
+            Udp
+        };
+
+        struct ClientStatistics
+        {
+            std::string title_;
+            std::uint64_t messages_{0};
+            std::uint64_t bytes_{0};
+            std::chrono::system_clock::time_point lastSeen_{};
+        };
+
+        struct DatagramCounters
+        {
+            std::uint64_t datagrams_{0}; // received by server, sent by client
+            std::uint64_t truncated_{0}; // didn't fit into the receive buffer
+            std::uint64_t dropped_{0};   // overflowed socket queue on server, refused to send on client
+        };
+
         namespace server
         {
             class Server
@@ -18,10 +58,43 @@ namespace libs
                     std::string address_{"127.0.0.1"};
                     int port_{8080};
                     int waitingTimeoutMilliseconds_ = 100;
+                    std::function<void(ConnectionId)> connectionCallback_{};
+
+                    // Unix socket for hot upgrade. If a server is already listening on it,
+                    // its listening socket and connections are taken over, otherwise the
+                    // server binds normally and waits for a successor on this path
+                    std::string upgradeSocketPath_{};
+
+                    // Threads reading connections, each owns a fixed shard of them
+                    int workersCount_{2};
+
+                    // CPUs for the epoll loop and for worker threads, empty - not pinned.
+                    // Pinned threads allocate their memory on the local NUMA node
+                    std::vector<int> reactorCpus_{};
+                    std::vector<int> workerCpus_{};
+
+                    // Spin on non-blocking epoll_wait this long before blocking, 0 - disabled
+                    int busyPollMicroseconds_{0};
+
+                    // Udp - every datagram is passed to the callback, batched with recvmmsg
+                    Transport transport_{Transport::Tcp};
+
+                    // Records every received chunk (datagram in Udp mode) with a timestamp and
+                    // connection id to this file for replay_client, empty - disabled.
+                    // In Udp mode the id is the sender address
+                    std::string captureFilePath_{};
+
+                    // Per-client statistics are kept by every worker without locks and
+                    // merged on request. Non-zero - workers also publish them periodically
+                    int statisticsIntervalMilliseconds_{0};
+
+                    // Diagnostics below it are not even formatted, received messages are always passed
+                    LogLevel logLevel_{LogLevel::Info};
                 };
 
                 Server() = delete;
-                Server(std::function<void(const std::string &)> logCallback);
+                Server(std::function<void(std::string_view)> logCallback);
+                Server(LogCallback logCallback);
 
                 Server(const Server &) = default;
                 Server &operator=(const Server &) = default;
@@ -34,6 +107,21 @@ namespace libs
                 bool start(const Config &config);
                 void stop();
 
+                // Queue data to the connection's output queue. File ranges and pipes are
+                // transmitted with sendfile/splice without copying into user space.
+                // Descriptors are duplicated, so the caller may close them right away.
+                // Udp mode has no connections to send to, all of them return false
+                bool send(ConnectionId connectionId, const std::string &message);
+                bool sendFile(ConnectionId connectionId, int fileFD, off_t offset, std::size_t count);
+                bool sendPipe(ConnectionId connectionId, int pipeFD, std::size_t count);
+
+                DatagramCounters datagramCounters() const;
+
+                // Per client title (connection id "#N" for unknown message format).
+                // refresh - ask every worker for fresh counters, otherwise merge the last published
+                std::vector<ClientStatistics> clientStatistics(bool refresh = true);
+                std::vector<ClientStatistics> topClients(std::size_t count, bool refresh = true);
+
             private:
                 class ServerImpl;
                 std::unique_ptr<ServerImpl> serverImpl_;
@@ -51,10 +139,19 @@ namespace libs
                     std::string address_{"127.0.0.1"};
                     int port_{8080};
                     int reconnectingTimeoutSeconds_{1};
+
+                    // Udp - no reconnects, queued datagrams are sent with sendmmsg every
+                    // reconnecting timeout or as soon as a batch is full
+                    Transport transport_{Transport::Tcp};
+                    std::size_t datagramBatchSize_{32};
+
+                    // Messages below it are not even formatted
+                    LogLevel logLevel_{LogLevel::Info};
                 };
 
                 Client() = delete;
-                Client(std::function<void(const std::string &)> logCallback);
+                Client(std::function<void(std::string_view)> logCallback);
+                Client(LogCallback logCallback);
 
                 Client(const Client &) = default;
                 Client &operator=(const Client &) = default;
@@ -67,6 +164,15 @@ namespace libs
                 bool start(const Config &config);
                 void stop();
 
+                // Queued transfers are sent after the title message of the next connection.
+                // In Udp mode the message is queued as a single datagram, files and
+                // pipes aren't supported there and return false
+                bool send(const std::string &message);
+                bool sendFile(int fileFD, off_t offset, std::size_t count);
+                bool sendPipe(int pipeFD, std::size_t count);
+
+                DatagramCounters datagramCounters() const;
+
             private:
                 class ClientImpl;
                 std::unique_ptr<ClientImpl> clientImpl_;
@@ -0,0 +1,180 @@
+#include "output_queue.h"
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+#define COMPACT_THRESHOLD 64
+
+namespace libs
+{
+    namespace network
+    {
+        OutputQueue::~OutputQueue()
+        {
+            clear();
+        }
+
+        void OutputQueue::clear()
+        {
+            while (!empty())
+                popFront();
+        }
+
+        void OutputQueue::pushBuffer(std::string data)
+        {
+            if (data.empty())
+                return;
+
+            Chunk chunk;
+            chunk.kind_ = Chunk::Kind::Buffer;
+            chunk.remaining_ = data.size();
+            chunk.data_ = std::move(data);
+            chunks_.push_back(std::move(chunk));
+        }
+
+        void OutputQueue::pushFile(int fileFD, off_t offset, std::size_t count)
+        {
+            Chunk chunk;
+            chunk.kind_ = Chunk::Kind::File;
+            chunk.fd_ = fileFD;
+            chunk.offset_ = offset;
+            chunk.remaining_ = count;
+            chunks_.push_back(std::move(chunk));
+        }
+
+        void OutputQueue::pushPipe(int pipeFD, std::size_t count)
+        {
+            Chunk chunk;
+            chunk.kind_ = Chunk::Kind::Pipe;
+            chunk.fd_ = pipeFD;
+            chunk.remaining_ = count;
+            chunks_.push_back(std::move(chunk));
+        }
+
+        bool OutputQueue::empty() const
+        {
+            return head_ == chunks_.size();
+        }
+
+        int OutputQueue::stalledPipeFD() const
+        {
+            if (empty() || chunks_[head_].kind_ != Chunk::Kind::Pipe)
+                return -1;
+
+            return chunks_[head_].fd_;
+        }
+
+        void OutputQueue::dropPartial()
+        {
+            if (!empty() && chunks_[head_].started_)
+                popFront();
+        }
+
+        void OutputQueue::dropFront()
+        {
+            if (!empty())
+                popFront();
+        }
+
+        OutputQueue::FlushResult OutputQueue::flush(int socketFD, std::size_t budget)
+        {
+            while (!empty())
+            {
+                if (budget == 0)
+                    return FlushResult::Pending;
+
+                Chunk &chunk = chunks_[head_];
+                if (chunk.remaining_ == 0)
+                {
+                    popFront();
+                    continue;
+                }
+
+                const std::size_t kToWrite = std::min(chunk.remaining_, budget);
+                ssize_t written = -1;
+
+                switch (chunk.kind_)
+                {
+                case Chunk::Kind::Buffer:
+                {
+                    const std::size_t kSent = chunk.data_.size() - chunk.remaining_;
+                    written = ::send(socketFD, chunk.data_.data() + kSent, kToWrite, MSG_NOSIGNAL);
+                    break;
+                }
+                case Chunk::Kind::File:
+                    written = sendfile(socketFD, chunk.fd_, &chunk.offset_, kToWrite);
+                    break;
+                case Chunk::Kind::Pipe:
+                    written = splice(chunk.fd_, nullptr, socketFD, nullptr, kToWrite,
+                                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+                    break;
+                }
+
+                if (written == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        if (chunk.kind_ != Chunk::Kind::Pipe)
+                            return FlushResult::WouldBlock;
+
+                        // Either side of splice may be empty/full, ask the socket
+                        pollfd pfd{socketFD, POLLOUT, 0};
+                        if (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT))
+                            return FlushResult::Stalled;
+
+                        return FlushResult::WouldBlock;
+                    }
+
+                    return FlushResult::Error;
+                }
+
+                if (written == 0)
+                {
+                    // File is shorter than requested or pipe writer is closed
+                    popFront();
+                    continue;
+                }
+
+                chunk.started_ = true;
+                chunk.remaining_ -= written;
+                budget -= written;
+
+                if (chunk.remaining_ == 0)
+                    popFront();
+            }
+
+            return FlushResult::Done;
+        }
+
+        void OutputQueue::popFront()
+        {
+            Chunk &chunk = chunks_[head_];
+            if (chunk.fd_ != -1)
+                close(chunk.fd_);
+
+            // Released right away, only the vector slot waits for the reset
+            std::string().swap(chunk.data_);
+            ++head_;
+
+            if (empty())
+            {
+                chunks_.clear();
+                head_ = 0;
+            }
+            else if (head_ >= COMPACT_THRESHOLD && head_ * 2 >= chunks_.size())
+            {
+                // Queue that never drains doesn't grow without bound
+                chunks_.erase(chunks_.begin(), chunks_.begin() + head_);
+                head_ = 0;
+            }
+        }
+    }
+}
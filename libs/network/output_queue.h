@@ -0,0 +1,84 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace libs
+{
+    namespace network
+    {
+        // Per-connection queue of pending output. Buffers are written with send(2),
+        // file ranges with sendfile(2) and pipes with splice(2), so bulk payloads
+        // never pass through user space.
+        class OutputQueue
+        {
+        public:
+            enum class FlushResult
+            {
+                Done,       // queue is empty
+                Pending,    // budget is exhausted, socket is still writable
+                WouldBlock, // socket buffer is full, wait for EPOLLOUT
+                Stalled,    // pipe has no data yet
+                Error
+            };
+
+            OutputQueue() = default;
+            ~OutputQueue();
+
+            OutputQueue(const OutputQueue &) = delete;
+            OutputQueue &operator=(const OutputQueue &) = delete;
+
+            OutputQueue(const OutputQueue &&) = delete;
+            OutputQueue &operator=(const OutputQueue &&) = delete;
+
+            void pushBuffer(std::string data);
+
+            // Takes ownership of the descriptors
+            void pushFile(int fileFD, off_t offset, std::size_t count);
+            void pushPipe(int pipeFD, std::size_t count);
+
+            bool empty() const;
+
+            // Closes queued descriptors, keeps the storage for reuse
+            void clear();
+
+            // Pipe the front chunk waits on after Stalled, -1 if the front isn't a pipe
+            int stalledPipeFD() const;
+
+            // After a failed flush the peer got only a part of the front chunk,
+            // it can't be resumed on another connection
+            void dropPartial();
+            void dropFront();
+
+            // Writes at most `budget` bytes to the socket
+            FlushResult flush(int socketFD, std::size_t budget);
+
+        private:
+            struct Chunk
+            {
+                enum class Kind
+                {
+                    Buffer,
+                    File,
+                    Pipe
+                };
+
+                Kind kind_{Kind::Buffer};
+                std::string data_;
+                int fd_{-1};
+                off_t offset_{0};
+                std::size_t remaining_{0};
+                bool started_{false};
+            };
+
+            void popFront();
+
+            // Popped chunks are skipped by head_ and the storage is reset once the
+            // queue drains, so a reused queue doesn't allocate until it outgrows it
+            std::vector<Chunk> chunks_;
+            std::size_t head_{0};
+        };
+    }
+}
@@ -1,33 +1,69 @@
 #include "network.h"
+#include "output_queue.h"
+#include "handover.h"
+#include "affinity.h"
+#include "datagram.h"
+#include "capture.h"
+#include "statistics.h"
+#include "log.h"
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <array>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 
 #define MAX_EVENTS 10
 #define READ_BUFFER_SIZE 1024
+#define WORKER_QUEUE_SIZE 1024
+#define DATAGRAM_BATCH_SIZE 64
+#define DATAGRAM_BUFFER_SIZE 2048
+#define DATAGRAM_BATCHES_PER_CYCLE 8
+#define STATISTICS_REQUEST_TIMEOUT_MILLISECONDS 1000
+#define WRITE_QUANTUM_SIZE (64 * 1024)
+#define HANDOVER_DRAIN_TIMEOUT_SECONDS 5
+#define CONNECTION_POOL_SIZE 256
 
 namespace
 {
-    void handleExistingConection(int clientFD, std::function<void(const std::string &)> logCallback)
+    // Reads until the socket is drained (it is edge-triggered), returns false
+    // if the connection has to be closed
+    template <typename OnData>
+    bool handleExistingConection(int clientFD, char *readBuffer, OnData &&onData,
+                                 const libs::network::Log &log)
     {
-        char readBuffer[READ_BUFFER_SIZE];
-        int bytes_read = read(clientFD, readBuffer, READ_BUFFER_SIZE);
-        if (bytes_read == -1)
+        while (true)
         {
-            logCallback("Failed to read");
-            close(clientFD);
-        }
-        else if (bytes_read == 0)
-        {
-            close(clientFD);
-        }
-        else
-        {
-            logCallback(std::string(readBuffer, bytes_read));
+            ssize_t bytes_read = read(clientFD, readBuffer, READ_BUFFER_SIZE);
+            if (bytes_read > 0)
+            {
+                onData(std::string_view(readBuffer, bytes_read));
+            }
+            else if (bytes_read == 0)
+            {
+                return false;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return true;
+            }
+            else if (errno != EINTR)
+            {
+                log(libs::network::LogLevel::Error, "Failed to read");
+                return false;
+            }
         }
     }
 }
@@ -48,8 +84,11 @@ namespace libs
                 ServerImpl(const ServerImpl &) = default;
                 ServerImpl &operator=(const ServerImpl &) = default;
 
-                ServerImpl(std::function<void(const std::string &)> logCallback) : logCallback_(logCallback)
+                ServerImpl(LogCallback logCallback) : log_(std::move(logCallback))
                 {
+                    commands_.reserve(MAX_EVENTS);
+                    pendingCommands_.reserve(MAX_EVENTS);
+                    freeConnections_.reserve(CONNECTION_POOL_SIZE);
                 }
                 ~ServerImpl()
                 {
@@ -60,24 +99,64 @@ namespace libs
                 {
                     if (isRunning_.load())
                     {
-                        logCallback_("Server already started");
+                        log_(LogLevel::Warning, "Server already started");
                         return false;
                     }
 
                     config_ = config;
+                    transport_.store(config_.transport_);
+                    handedOver_ = false;
+                    log_.setLevel(config_.logLevel_);
 
-                    if (!createAndBind())
+                    if (!config_.captureFilePath_.empty() &&
+                        !capture_.open(config_.captureFilePath_, config_.transport_))
+                    {
+                        log_(LogLevel::Error, "Failed to open capture file: ", config_.captureFilePath_);
+                        return false;
+                    }
+
+                    // The reactor runs on the caller's thread, which gets its own CPUs and
+                    // memory policy back when the server stops
+                    affinity::PlacementGuard callerPlacement;
+
+                    // Before any reactor state is allocated, so it is NUMA-local
+                    if (!affinity::pinCurrentThread(config_.reactorCpus_))
+                        log_(LogLevel::Warning, "Failed to pin reactor thread");
+
+                    std::vector<handover::Connection> inheritedConnections;
+                    if (!takeOver(inheritedConnections) && !createAndBind())
                     {
                         closeConnection();
                         return false;
                     }
 
                     if (!setupEpoll())
+                    {
+                        for (const auto &connection : inheritedConnections)
+                            close(connection.fd_);
+
+                        closeConnection();
+                        return false;
+                    }
+
+                    for (const auto &connection : inheritedConnections)
+                        addClient(connection.id_, connection.fd_);
+
+                    startWorkers(callerPlacement);
+
+                    // Allocated by the (possibly pinned) reactor thread, so it is NUMA-local
+                    if (config_.transport_ == Transport::Udp)
+                        datagramReceiver_ = std::make_unique<DatagramReceiver>(DATAGRAM_BATCH_SIZE, DATAGRAM_BUFFER_SIZE);
+
+                    if (!setupUpgradeListener())
                     {
                         closeConnection();
                         return false;
                     }
 
+                    // Peer may disconnect in the middle of sendfile/splice
+                    signal(SIGPIPE, SIG_IGN);
+
                     runServer();
 
                     closeConnection();
@@ -92,13 +171,340 @@ namespace libs
                     isRunning_.store(false);
                 }
 
+                DatagramCounters datagramCounters() const
+                {
+                    DatagramCounters counters;
+                    counters.datagrams_ = datagramsReceived_.load(std::memory_order_relaxed);
+                    counters.truncated_ = datagramsTruncated_.load(std::memory_order_relaxed);
+                    counters.dropped_ = datagramsDropped_.load(std::memory_order_relaxed);
+                    return counters;
+                }
+
+                std::vector<ClientStatistics> clientStatistics(bool refresh)
+                {
+                    std::unique_lock<std::mutex> lock(statisticsMutex_);
+
+                    if (refresh)
+                    {
+                        const std::uint64_t kEpoch = requestedEpoch_.fetch_add(1) + 1;
+
+                        // Reactor publishes its shard and wakes the workers to publish theirs
+                        if (post([this]()
+                                 { requestStatistics(); }))
+                        {
+                            statisticsCondition_.wait_for(lock, std::chrono::milliseconds(STATISTICS_REQUEST_TIMEOUT_MILLISECONDS),
+                                                          [this, kEpoch]()
+                                                          {
+                                                              return std::all_of(statisticsShards_.begin(), statisticsShards_.end(),
+                                                                                 [kEpoch](const auto &shard)
+                                                                                 { return shard->publishedEpoch() >= kEpoch; });
+                                                          });
+                        }
+                        else
+                        {
+                            // Not running, nobody owns the shards anymore
+                            for (auto &shard : statisticsShards_)
+                                shard->publish(kEpoch);
+                        }
+                    }
+
+                    ClientStatisticsMap merged;
+                    for (const auto &shard : statisticsShards_)
+                        shard->mergeTo(merged);
+
+                    std::vector<ClientStatistics> statistics;
+                    statistics.reserve(merged.size());
+                    for (auto &[title, clientStatistics] : merged)
+                        statistics.push_back(std::move(clientStatistics));
+
+                    return statistics;
+                }
+
+                bool send(ConnectionId connectionId, const std::string &message)
+                {
+                    // config_ belongs to the reactor thread, send*() use a copy. Datagram
+                    // senders aren't connections, nothing can be sent to them
+                    if (transport_.load() == Transport::Udp)
+                        return false;
+
+                    return post([this, connectionId, message]() mutable
+                                {
+                                    Connection *connection = findConnection(connectionId);
+                                    if (!connection)
+                                        return;
+
+                                    connection->output_.pushBuffer(std::move(message));
+                                    scheduleWrite(connectionId, *connection); });
+                }
+
+                bool sendFile(ConnectionId connectionId, int fileFD, off_t offset, std::size_t count)
+                {
+                    if (transport_.load() == Transport::Udp)
+                        return false;
+
+                    const int kFD = dup(fileFD);
+                    if (kFD == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to duplicate file descriptor");
+                        return false;
+                    }
+
+                    return post([this, connectionId, kFD, offset, count]()
+                                {
+                                    Connection *connection = findConnection(connectionId);
+                                    if (!connection)
+                                    {
+                                        close(kFD);
+                                        return;
+                                    }
+
+                                    connection->output_.pushFile(kFD, offset, count);
+                                    scheduleWrite(connectionId, *connection); },
+                                kFD);
+                }
+
+                bool sendPipe(ConnectionId connectionId, int pipeFD, std::size_t count)
+                {
+                    if (transport_.load() == Transport::Udp)
+                        return false;
+
+                    const int kFD = dup(pipeFD);
+                    if (kFD == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to duplicate pipe descriptor");
+                        return false;
+                    }
+
+                    return post([this, connectionId, kFD, count]()
+                                {
+                                    Connection *connection = findConnection(connectionId);
+                                    if (!connection)
+                                    {
+                                        close(kFD);
+                                        return;
+                                    }
+
+                                    connection->output_.pushPipe(kFD, count);
+                                    scheduleWrite(connectionId, *connection); },
+                                kFD);
+                }
+
             private:
+                // Closing goes through the owning worker's queue as well, so the descriptor
+                // can't be reused while reads queued before it are pending
+                struct Job
+                {
+                    ConnectionId id_{0};
+                    int fd_{-1};
+                    bool isClose_{false};
+                };
+
+                // Connections are sharded between workers, so reads of one connection stay ordered
+                struct Worker
+                {
+                    std::thread thread_;
+                    std::mutex mutex_;
+                    std::condition_variable condition_;
+                    std::condition_variable notFull_;
+                    std::array<Job, WORKER_QUEUE_SIZE> jobs_;
+                    std::size_t head_{0};
+                    std::size_t size_{0};
+                    bool running_{true};
+                    StatisticsShard *statistics_{nullptr};
+                };
+
+                struct Connection
+                {
+                    int fd_{-1};
+                    bool writable_{true};
+                    bool scheduled_{false};
+                    int stalledPipeFD_{-1};
+                    OutputQueue output_;
+                };
+
+                using ConnectionMap = std::unordered_map<ConnectionId, Connection>;
+
+                // Receives the listening socket and live connections from the running
+                // server, returns false if there is no one to take over from
+                bool takeOver(std::vector<handover::Connection> &connections)
+                {
+                    if (config_.upgradeSocketPath_.empty())
+                        return false;
+
+                    const int kPeerFD = handover::connectTo(config_.upgradeSocketPath_);
+                    if (kPeerFD == -1)
+                        return false;
+
+                    log_(LogLevel::Info, "Taking over from running server...");
+
+                    handover::Header header;
+                    int listenerFD = kIncorrectSocketValue_;
+                    const bool kReceived = handover::receive(kPeerFD, header, listenerFD, connections);
+                    close(kPeerFD);
+
+                    if (!kReceived)
+                    {
+                        log_(LogLevel::Error, "Failed to take over from running server");
+                        return false;
+                    }
+
+                    // E.g. a Tcp server would accept on a datagram socket
+                    if (header.transport_ != config_.transport_)
+                    {
+                        log_(LogLevel::Error, "Running server uses another transport, its sockets are dropped");
+
+                        for (const auto &connection : connections)
+                            close(connection.fd_);
+                        connections.clear();
+
+                        close(listenerFD);
+                        return false;
+                    }
+
+                    serverSocketFD_ = listenerFD;
+                    nextConnectionId_ = std::max(nextConnectionId_, header.nextConnectionId_);
+
+                    log_(LogLevel::Info, "Took over ", connections.size(), " connections");
+                    return true;
+                }
+
+                bool setupUpgradeListener()
+                {
+                    if (config_.upgradeSocketPath_.empty())
+                        return true;
+
+                    upgradeListenerFD_ = handover::createListener(config_.upgradeSocketPath_);
+                    if (upgradeListenerFD_ == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to create upgrade socket: ", config_.upgradeSocketPath_);
+                        return false;
+                    }
+
+                    epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = kUpgradeId_;
+                    if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, upgradeListenerFD_, &ev) == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to configure epoll");
+                        return false;
+                    }
+
+                    return true;
+                }
+
+                // New server process connected: stop accepting, let in-flight work
+                // finish and hand everything over
+                void handleUpgradeRequest()
+                {
+                    const int kPeerFD = accept4(upgradeListenerFD_, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (kPeerFD == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to accept upgrade request");
+                        return;
+                    }
+
+                    if (upgradePeerFD_ != kIncorrectSocketValue_)
+                    {
+                        close(kPeerFD);
+                        return;
+                    }
+
+                    epoll_ctl(epollFD_, EPOLL_CTL_DEL, serverSocketFD_, nullptr);
+
+                    upgradePeerFD_ = kPeerFD;
+                    drainDeadline_ = std::chrono::steady_clock::now() +
+                                     std::chrono::seconds(HANDOVER_DRAIN_TIMEOUT_SECONDS);
+
+                    log_(LogLevel::Info, "Upgrade requested, draining connections...");
+                }
+
+                bool isDrained()
+                {
+                    if (std::chrono::steady_clock::now() >= drainDeadline_)
+                    {
+                        log_(LogLevel::Warning, "Drain timeout, handing over anyway");
+                        return true;
+                    }
+
+                    if (inFlightHandlers_.load() != 0 || !writeReady_.empty())
+                        return false;
+
+                    for (const auto &[id, connection] : connections_)
+                        if (!connection.output_.empty())
+                            return false;
+
+                    std::lock_guard<std::mutex> lock(commandsMutex_);
+                    return commands_.empty();
+                }
+
+                void handOver()
+                {
+                    // After a drain timeout workers may still be reading the sockets closed
+                    // below. Nothing is dispatched meanwhile, so the count only goes down
+                    while (inFlightHandlers_.load() != 0)
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                    // Closes posted by the finished jobs, those connections aren't handed over
+                    handleCommands();
+
+                    std::vector<handover::Connection> connections;
+                    connections.reserve(connections_.size());
+                    for (const auto &[id, connection] : connections_)
+                        connections.push_back({id, connection.fd_});
+
+                    handover::Header header;
+                    header.connectionsCount_ = connections.size();
+                    header.nextConnectionId_ = nextConnectionId_;
+                    header.transport_ = config_.transport_;
+
+                    const bool kSent = handover::send(upgradePeerFD_, header, serverSocketFD_, connections);
+
+                    close(upgradePeerFD_);
+                    upgradePeerFD_ = kIncorrectSocketValue_;
+
+                    if (!kSent)
+                    {
+                        log_(LogLevel::Warning, "Failed to hand over, continue serving");
+
+                        epoll_event ev;
+                        ev.events = EPOLLIN;
+                        ev.data.u64 = kListenerId_;
+                        if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, serverSocketFD_, &ev) == -1)
+                        {
+                            log_(LogLevel::Error, "Failed to configure epoll");
+                            isRunning_.store(false);
+                        }
+                        return;
+                    }
+
+                    for (const auto &[id, connection] : connections_)
+                    {
+                        if (!connection.output_.empty())
+                            log_(LogLevel::Warning, "Queued output of connection #", id, " is lost on handover");
+                    }
+
+                    // Sockets stay open in the new process, only this copy is released
+                    for (const auto &connection : connections)
+                    {
+                        epoll_ctl(epollFD_, EPOLL_CTL_DEL, connection.fd_, nullptr);
+                        close(connection.fd_);
+                    }
+                    connections_.clear();
+
+                    handedOver_ = true;
+                    isRunning_.store(false);
+
+                    log_(LogLevel::Info, "Handed over ", connections.size(), " connections");
+                }
+
                 bool createAndBind()
                 {
-                    serverSocketFD_ = socket(AF_INET, SOCK_STREAM, 0);
+                    const bool kIsDatagram = config_.transport_ == Transport::Udp;
+
+                    serverSocketFD_ = socket(AF_INET, kIsDatagram ? SOCK_DGRAM : SOCK_STREAM, 0);
                     if (serverSocketFD_ == -1)
                     {
-                        logCallback_("Failed to create socket");
+                        log_(LogLevel::Error, "Failed to create socket");
                         return false;
                     }
 
@@ -108,19 +514,28 @@ namespace libs
                     serverAddr.sin_port = htons(config_.port_);
                     if (inet_pton(AF_INET, config_.address_.c_str(), &serverAddr.sin_addr) == -1)
                     {
-                        logCallback_("Invalid address/ Address not supported");
+                        log_(LogLevel::Error, "Invalid address/ Address not supported");
                         return false;
                     }
 
                     if (bind(serverSocketFD_, (sockaddr *)&serverAddr, sizeof(serverAddr)) == -1)
                     {
-                        logCallback_("Failed to bind");
+                        log_(LogLevel::Error, "Failed to bind");
                         return false;
                     }
 
+                    if (kIsDatagram)
+                    {
+                        const int kEnable = 1;
+                        if (setsockopt(serverSocketFD_, SOL_SOCKET, SO_RXQ_OVFL, &kEnable, sizeof(kEnable)) == -1)
+                            log_(LogLevel::Warning, "Failed to enable drop counter");
+
+                        return setNonBlocking(serverSocketFD_);
+                    }
+
                     if (listen(serverSocketFD_, SOMAXCONN) == -1)
                     {
-                        logCallback_("Failed to listen");
+                        log_(LogLevel::Error, "Failed to listen");
                         return false;
                     }
 
@@ -132,16 +547,31 @@ namespace libs
                     epollFD_ = epoll_create1(0);
                     if (epollFD_ == -1)
                     {
-                        logCallback_("Failed to create epoll");
+                        log_(LogLevel::Error, "Failed to create epoll");
                         return false;
                     }
 
                     epoll_event ev;
                     ev.events = EPOLLIN;
-                    ev.data.fd = serverSocketFD_;
+                    ev.data.u64 = kListenerId_;
                     if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, serverSocketFD_, &ev) == -1)
                     {
-                        logCallback_("Failed to configure epoll");
+                        log_(LogLevel::Error, "Failed to configure epoll");
+                        return false;
+                    }
+
+                    eventFD_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                    if (eventFD_ == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to create eventfd");
+                        return false;
+                    }
+
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = kWakeupId_;
+                    if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, eventFD_, &ev) == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to configure epoll");
                         return false;
                     }
 
@@ -154,33 +584,411 @@ namespace libs
 
                     isRunning_.store(true);
 
-                    logCallback_("Server(" + config_.address_ + ":" + std::to_string(config_.port_) + ") started...");
+                    log_(LogLevel::Info, "Server(", config_.address_, ":", config_.port_, ") started...");
 
                     while (isRunning_.load())
                     {
-                        int n = epoll_wait(epollFD_, events, MAX_EVENTS, config_.waitingTimeoutMilliseconds_);
+                        const int kTimeout = writeReady_.empty() ? config_.waitingTimeoutMilliseconds_ : 0;
+                        int n = waitForEvents(events, kTimeout);
                         if (n == -1)
                         {
-                            logCallback_("Failed to epoll_wait");
+                            if (errno == EINTR)
+                                continue;
+
+                            log_(LogLevel::Error, "Failed to epoll_wait");
                             break;
                         }
 
                         for (int i = 0; i < n; ++i)
                         {
-                            if (events[i].data.fd == serverSocketFD_)
+                            const ConnectionId kId = events[i].data.u64;
+                            const uint32_t kEvents = events[i].events;
+
+                            if (kId == kListenerId_)
                             {
-                                handleNewConnection();
+                                if (datagramReceiver_)
+                                    handleDatagrams();
+                                else
+                                    handleNewConnection();
+                            }
+                            else if (kId == kWakeupId_)
+                            {
+                                handleCommands();
+                            }
+                            else if (kId == kUpgradeId_)
+                            {
+                                handleUpgradeRequest();
+                            }
+                            else if (kId & kStalledPipeFlag_)
+                            {
+                                resumeStalledWrite(kId & ~kStalledPipeFlag_);
                             }
                             else
                             {
-                                std::thread clientThread(
-                                    &handleExistingConection, events[i].data.fd, logCallback_);
-                                clientThread.detach();
+                                Connection *connection = findConnection(kId);
+                                if (!connection)
+                                    continue;
+
+                                if (kEvents & EPOLLOUT)
+                                {
+                                    connection->writable_ = true;
+                                    scheduleWrite(kId, *connection);
+                                }
+
+                                if (kEvents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                                    dispatch({kId, connection->fd_});
                             }
                         }
+
+                        handleWrites();
+
+                        if (isStatisticsPublishDue(*statisticsShards_.front()))
+                            publishStatistics(*statisticsShards_.front());
+
+                        if (upgradePeerFD_ != kIncorrectSocketValue_ && isDrained())
+                            handOver();
+                    }
+
+                    log_(LogLevel::Info, "Escaped from listening cycle");
+                }
+
+                // Workers not given their own CPUs get the caller's placement back instead
+                // of inheriting the pinned reactor's. They are joined before it goes away
+                void startWorkers(const affinity::PlacementGuard &callerPlacement)
+                {
+                    const int kWorkersCount = std::max(1, config_.workersCount_);
+
+                    {
+                        // The first shard belongs to the reactor (datagrams), the rest to workers
+                        std::lock_guard<std::mutex> lock(statisticsMutex_);
+                        statisticsShards_.clear();
+                        for (int i = 0; i <= kWorkersCount; ++i)
+                            statisticsShards_.push_back(std::make_unique<StatisticsShard>(i != 0));
+                    }
+
+                    for (int i = 0; i < kWorkersCount; ++i)
+                    {
+                        workers_.push_back(std::make_unique<Worker>());
+                        workers_.back()->statistics_ = statisticsShards_[i + 1].get();
+                        workers_.back()->thread_ = std::thread(&ServerImpl::runWorker, this, std::ref(*workers_.back()), std::cref(callerPlacement));
+                    }
+                }
+
+                void requestStatistics()
+                {
+                    publishStatistics(*statisticsShards_.front());
+
+                    for (auto &worker : workers_)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(worker->mutex_);
+                        }
+                        worker->condition_.notify_one();
+                    }
+                }
+
+                void publishStatistics(StatisticsShard &statistics)
+                {
+                    statistics.publish(requestedEpoch_.load());
+
+                    {
+                        std::lock_guard<std::mutex> lock(statisticsMutex_);
+                    }
+                    statisticsCondition_.notify_all();
+                }
+
+                bool isStatisticsPublishDue(const StatisticsShard &statistics) const
+                {
+                    return statistics.isPublishDue(requestedEpoch_.load(),
+                                                   std::chrono::milliseconds(config_.statisticsIntervalMilliseconds_));
+                }
+
+                void stopWorkers()
+                {
+                    for (auto &worker : workers_)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(worker->mutex_);
+                            worker->running_ = false;
+                        }
+                        worker->condition_.notify_all();
+                        worker->notFull_.notify_all();
+                    }
+
+                    for (auto &worker : workers_)
+                        if (worker->thread_.joinable())
+                            worker->thread_.join();
+
+                    workers_.clear();
+                }
+
+                bool dispatch(const Job &job)
+                {
+                    Worker &worker = *workers_[job.id_ % workers_.size()];
+                    {
+                        std::unique_lock<std::mutex> lock(worker.mutex_);
+                        worker.notFull_.wait(lock, [&worker]
+                                             { return worker.size_ < WORKER_QUEUE_SIZE || !worker.running_; });
+                        if (!worker.running_)
+                            return false;
+
+                        worker.jobs_[(worker.head_ + worker.size_) % WORKER_QUEUE_SIZE] = job;
+                        ++worker.size_;
+                        inFlightHandlers_.fetch_add(1);
+                    }
+                    worker.condition_.notify_one();
+                    return true;
+                }
+
+                void runWorker(Worker &worker, const affinity::PlacementGuard &callerPlacement)
+                {
+                    if (config_.workerCpus_.empty())
+                        callerPlacement.apply();
+                    else if (!affinity::pinCurrentThread(config_.workerCpus_))
+                        log_(LogLevel::Warning, "Failed to pin worker thread");
+
+                    // Recycled for every job, first touched by this thread so it is NUMA-local
+                    char readBuffer[READ_BUFFER_SIZE];
+
+                    const auto kWakeUp = [this, &worker]()
+                    {
+                        return worker.size_ != 0 || !worker.running_ || isStatisticsPublishDue(*worker.statistics_);
+                    };
+
+                    std::unique_lock<std::mutex> lock(worker.mutex_);
+                    while (true)
+                    {
+                        if (config_.statisticsIntervalMilliseconds_ > 0)
+                            worker.condition_.wait_for(lock, std::chrono::milliseconds(config_.statisticsIntervalMilliseconds_), kWakeUp);
+                        else
+                            worker.condition_.wait(lock, kWakeUp);
+
+                        if (isStatisticsPublishDue(*worker.statistics_))
+                        {
+                            lock.unlock();
+                            publishStatistics(*worker.statistics_);
+                            lock.lock();
+                        }
+
+                        if (worker.size_ == 0)
+                        {
+                            if (!worker.running_)
+                                break;
+
+                            continue;
+                        }
+
+                        const Job kJob = worker.jobs_[worker.head_];
+                        worker.head_ = (worker.head_ + 1) % WORKER_QUEUE_SIZE;
+                        --worker.size_;
+                        worker.notFull_.notify_one();
+                        lock.unlock();
+
+                        auto onData = [this, &worker, kId = kJob.id_](std::string_view data)
+                        { onMessage(*worker.statistics_, kId, data); };
+
+                        if (kJob.isClose_)
+                        {
+                            finishClient(kJob.id_, kJob.fd_);
+                            worker.statistics_->forget(kJob.id_);
+                        }
+                        else if (!handleExistingConection(kJob.fd_, readBuffer, onData, log_))
+                            post([this, kId = kJob.id_]()
+                                 { closeClient(kId); });
+
+                        inFlightHandlers_.fetch_sub(1);
+                        lock.lock();
+                    }
+                }
+
+                // In busy-poll mode spins on non-blocking epoll_wait for the configured
+                // budget before falling back to a blocking wait
+                int waitForEvents(epoll_event *events, int timeout)
+                {
+                    if (config_.busyPollMicroseconds_ <= 0 || timeout == 0)
+                        return epoll_wait(epollFD_, events, MAX_EVENTS, timeout);
+
+                    const auto kDeadline = std::chrono::steady_clock::now() +
+                                           std::chrono::microseconds(config_.busyPollMicroseconds_);
+                    do
+                    {
+                        const int kCount = epoll_wait(epollFD_, events, MAX_EVENTS, 0);
+                        if (kCount != 0)
+                            return kCount;
+                    } while (isRunning_.load(std::memory_order_relaxed) &&
+                             std::chrono::steady_clock::now() < kDeadline);
+
+                    return epoll_wait(epollFD_, events, MAX_EVENTS, timeout);
+                }
+
+                bool post(std::function<void()> command, int ownedFD = -1)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(commandsMutex_);
+                        if (eventFD_ == kIncorrectSocketValue_)
+                        {
+                            if (ownedFD != -1)
+                                close(ownedFD);
+                            return false;
+                        }
+
+                        commands_.push_back(std::move(command));
+
+                        const uint64_t kSignal = 1;
+                        if (write(eventFD_, &kSignal, sizeof(kSignal)) == -1 && errno != EAGAIN)
+                            log_(LogLevel::Error, "Failed to wake up server");
+                    }
+
+                    return true;
+                }
+
+                void handleCommands()
+                {
+                    uint64_t counter = 0;
+                    while (read(eventFD_, &counter, sizeof(counter)) > 0)
+                    {
                     }
 
-                    logCallback_("Escaped from listening cycle");
+                    {
+                        std::lock_guard<std::mutex> lock(commandsMutex_);
+                        pendingCommands_.swap(commands_);
+                    }
+
+                    // Both vectors keep their capacity, so posting doesn't allocate once warmed up
+                    for (auto &command : pendingCommands_)
+                        command();
+
+                    pendingCommands_.clear();
+                }
+
+                Connection *findConnection(ConnectionId connectionId)
+                {
+                    auto it = connections_.find(connectionId);
+                    if (it == connections_.end())
+                        return nullptr;
+
+                    return &it->second;
+                }
+
+                void scheduleWrite(ConnectionId connectionId, Connection &connection)
+                {
+                    if (connection.scheduled_ || !connection.writable_ || connection.output_.empty())
+                        return;
+
+                    connection.scheduled_ = true;
+                    writeReady_.push_back(connectionId);
+                }
+
+                // Every ready connection gets at most one quantum per cycle, so a large
+                // transfer can't starve small messages queued to other connections
+                void handleWrites()
+                {
+                    for (std::size_t i = writeReady_.size(); i > 0; --i)
+                    {
+                        const ConnectionId kId = writeReady_.front();
+                        writeReady_.pop_front();
+
+                        Connection *connection = findConnection(kId);
+                        if (!connection)
+                            continue;
+
+                        connection->scheduled_ = false;
+
+                        switch (connection->output_.flush(connection->fd_, WRITE_QUANTUM_SIZE))
+                        {
+                        case OutputQueue::FlushResult::Done:
+                            break;
+                        case OutputQueue::FlushResult::Pending:
+                            scheduleWrite(kId, *connection);
+                            break;
+                        case OutputQueue::FlushResult::WouldBlock:
+                            connection->writable_ = false;
+                            break;
+                        case OutputQueue::FlushResult::Stalled:
+                            waitForPipe(kId, *connection);
+                            break;
+                        case OutputQueue::FlushResult::Error:
+                            log_(LogLevel::Error, "Failed to send to client");
+                            closeClient(kId);
+                            break;
+                        }
+                    }
+                }
+
+                // Pipe without data: the write is parked until the pipe becomes readable
+                // (or its writer hangs up), EPOLLOUT can't reschedule it meanwhile
+                void waitForPipe(ConnectionId connectionId, Connection &connection)
+                {
+                    const int kPipeFD = connection.output_.stalledPipeFD();
+
+                    epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = connectionId | kStalledPipeFlag_;
+                    if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, kPipeFD, &ev) == -1)
+                    {
+                        log_(LogLevel::Error, "Failed to wait for pipe");
+                        closeClient(connectionId);
+                        return;
+                    }
+
+                    connection.stalledPipeFD_ = kPipeFD;
+                    connection.scheduled_ = true;
+                }
+
+                void resumeStalledWrite(ConnectionId connectionId)
+                {
+                    Connection *connection = findConnection(connectionId);
+                    if (!connection || connection->stalledPipeFD_ == kIncorrectSocketValue_)
+                        return;
+
+                    epoll_ctl(epollFD_, EPOLL_CTL_DEL, connection->stalledPipeFD_, nullptr);
+                    connection->stalledPipeFD_ = kIncorrectSocketValue_;
+                    connection->scheduled_ = false;
+                    scheduleWrite(connectionId, *connection);
+                }
+
+                void closeClient(ConnectionId connectionId)
+                {
+                    auto it = connections_.find(connectionId);
+                    if (it == connections_.end())
+                        return;
+
+                    if (it->second.stalledPipeFD_ != kIncorrectSocketValue_)
+                        epoll_ctl(epollFD_, EPOLL_CTL_DEL, it->second.stalledPipeFD_, nullptr);
+
+                    // Close record is written by the worker, after the reads still queued
+                    // for this connection, so replay doesn't reopen it
+                    epoll_ctl(epollFD_, EPOLL_CTL_DEL, it->second.fd_, nullptr);
+                    if (!dispatch({connectionId, it->second.fd_, true}))
+                        finishClient(connectionId, it->second.fd_);
+
+                    releaseConnection(it);
+                }
+
+                void finishClient(ConnectionId connectionId, int fd)
+                {
+                    if (!config_.captureFilePath_.empty())
+                        capture_.appendClose(connectionId);
+
+                    close(fd);
+                }
+
+                // Connection nodes (with their output queue storage) are reused, so
+                // clients reconnecting for every message don't allocate
+                void releaseConnection(ConnectionMap::iterator it)
+                {
+                    auto node = connections_.extract(it);
+                    if (freeConnections_.size() >= CONNECTION_POOL_SIZE)
+                        return;
+
+                    Connection &connection = node.mapped();
+                    connection.fd_ = kIncorrectSocketValue_;
+                    connection.writable_ = true;
+                    connection.scheduled_ = false;
+                    connection.stalledPipeFD_ = kIncorrectSocketValue_;
+                    connection.output_.clear();
+
+                    freeConnections_.push_back(std::move(node));
                 }
 
                 bool setNonBlocking(int fd)
@@ -188,19 +996,56 @@ namespace libs
                     int flags = fcntl(fd, F_GETFL, 0);
                     if (flags == -1)
                     {
-                        logCallback_("Failed to get flags");
+                        log_(LogLevel::Error, "Failed to get flags");
                         return false;
                     }
 
                     if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
                     {
-                        logCallback_("Failed to set flags");
+                        log_(LogLevel::Error, "Failed to set flags");
                         return false;
                     }
 
                     return true;
                 }
 
+                void onMessage(StatisticsShard &statistics, ConnectionId connectionId, std::string_view message)
+                {
+                    statistics.update(connectionId, message);
+
+                    if (!config_.captureFilePath_.empty())
+                        capture_.append(connectionId, message);
+
+                    log_.deliver(message);
+                }
+
+                void handleDatagrams()
+                {
+                    for (int batch = 0; batch < DATAGRAM_BATCHES_PER_CYCLE; ++batch)
+                    {
+                        const int kCount = datagramReceiver_->receive(serverSocketFD_);
+                        if (kCount == -1)
+                        {
+                            log_(LogLevel::Error, "Failed to receive datagrams");
+                            return;
+                        }
+
+                        for (int i = 0; i < kCount; ++i)
+                        {
+                            if (datagramReceiver_->isTruncated(i))
+                                datagramsTruncated_.fetch_add(1, std::memory_order_relaxed);
+
+                            onMessage(*statisticsShards_.front(), datagramReceiver_->source(i), datagramReceiver_->datagram(i));
+                        }
+
+                        datagramsReceived_.fetch_add(kCount, std::memory_order_relaxed);
+                        datagramsDropped_.store(datagramReceiver_->kernelDropped(), std::memory_order_relaxed);
+
+                        if (static_cast<std::size_t>(kCount) < datagramReceiver_->batchSize())
+                            return;
+                    }
+                }
+
                 void handleNewConnection()
                 {
                     sockaddr_in clientAddr;
@@ -208,31 +1053,85 @@ namespace libs
                     int clientFD = accept(serverSocketFD_, (sockaddr *)&clientAddr, &clientAddrLen);
                     if (clientFD == -1)
                     {
-                        logCallback_("Failed to accept");
+                        log_(LogLevel::Error, "Failed to accept");
                         return;
                     }
 
                     if (!setNonBlocking(clientFD))
                     {
-                        logCallback_("Failed to set nonblocking");
+                        log_(LogLevel::Error, "Failed to set nonblocking");
                         close(clientFD);
                         return;
                     }
 
+                    addClient(nextConnectionId_++, clientFD);
+                }
+
+                void addClient(ConnectionId connectionId, int clientFD)
+                {
                     epoll_event ev;
-                    ev.events = EPOLLIN | EPOLLET;
-                    ev.data.fd = clientFD;
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                    ev.data.u64 = connectionId;
 
                     if (epoll_ctl(epollFD_, EPOLL_CTL_ADD, clientFD, &ev) == -1)
                     {
-                        logCallback_("Failed to add new client");
+                        log_(LogLevel::Error, "Failed to add new client");
                         close(clientFD);
                         return;
                     }
+
+                    if (freeConnections_.empty())
+                    {
+                        connections_.try_emplace(connectionId).first->second.fd_ = clientFD;
+                    }
+                    else
+                    {
+                        auto node = std::move(freeConnections_.back());
+                        freeConnections_.pop_back();
+
+                        node.key() = connectionId;
+                        node.mapped().fd_ = clientFD;
+                        connections_.insert(std::move(node));
+                    }
+
+                    if (config_.connectionCallback_)
+                        config_.connectionCallback_(connectionId);
                 }
 
                 void closeConnection()
                 {
+                    stopWorkers();
+
+                    {
+                        std::lock_guard<std::mutex> lock(commandsMutex_);
+                        if (eventFD_ != kIncorrectSocketValue_)
+                            close(eventFD_);
+
+                        eventFD_ = kIncorrectSocketValue_;
+                        commands_.clear();
+                    }
+
+                    for (auto &[id, connection] : connections_)
+                        finishClient(id, connection.fd_);
+
+                    connections_.clear();
+                    writeReady_.clear();
+
+                    if (upgradePeerFD_ != kIncorrectSocketValue_)
+                        close(upgradePeerFD_);
+
+                    if (upgradeListenerFD_ != kIncorrectSocketValue_)
+                    {
+                        close(upgradeListenerFD_);
+
+                        // After handover the path belongs to the new process
+                        if (!handedOver_)
+                            unlink(config_.upgradeSocketPath_.c_str());
+                    }
+
+                    upgradePeerFD_ = kIncorrectSocketValue_;
+                    upgradeListenerFD_ = kIncorrectSocketValue_;
+
                     if (epollFD_ != kIncorrectSocketValue_)
                         close(epollFD_);
 
@@ -241,6 +1140,11 @@ namespace libs
 
                     serverSocketFD_ = kIncorrectSocketValue_;
                     epollFD_ = kIncorrectSocketValue_;
+
+                    datagramReceiver_.reset();
+
+                    if (!capture_.close())
+                        log_(LogLevel::Error, "Failed to finalize capture file");
                 }
 
             private:
@@ -249,13 +1153,55 @@ namespace libs
                 const int kIncorrectSocketValue_{-1};
                 int serverSocketFD_{kIncorrectSocketValue_};
                 int epollFD_{kIncorrectSocketValue_};
+                int eventFD_{kIncorrectSocketValue_};
+
+                static constexpr ConnectionId kListenerId_{0};
+                static constexpr ConnectionId kWakeupId_{1};
+                static constexpr ConnectionId kUpgradeId_{2};
+                ConnectionId nextConnectionId_{3};
+
+                // Tags events of a stalled pipe, the rest of the value is its connection
+                static constexpr ConnectionId kStalledPipeFlag_{ConnectionId{1} << 63};
+
+                int upgradeListenerFD_{kIncorrectSocketValue_};
+                int upgradePeerFD_{kIncorrectSocketValue_};
+                std::chrono::steady_clock::time_point drainDeadline_;
+                std::atomic<int> inFlightHandlers_{0};
+                bool handedOver_{false};
+
+                ConnectionMap connections_;
+                std::vector<ConnectionMap::node_type> freeConnections_;
+                std::deque<ConnectionId> writeReady_;
+
+                std::mutex commandsMutex_;
+                std::vector<std::function<void()>> commands_;
+                std::vector<std::function<void()>> pendingCommands_;
+
+                std::vector<std::unique_ptr<Worker>> workers_;
 
-                std::function<void(const std::string &)> logCallback_;
+                std::unique_ptr<DatagramReceiver> datagramReceiver_;
+                capture::Writer capture_;
 
+                // Shards are kept after stop, so statistics stay readable
+                std::mutex statisticsMutex_;
+                std::condition_variable statisticsCondition_;
+                std::vector<std::unique_ptr<StatisticsShard>> statisticsShards_;
+                std::atomic<std::uint64_t> requestedEpoch_{0};
+                std::atomic<std::uint64_t> datagramsReceived_{0};
+                std::atomic<std::uint64_t> datagramsTruncated_{0};
+                std::atomic<std::uint64_t> datagramsDropped_{0};
+
+                Log log_;
+
+                std::atomic<Transport> transport_{Transport::Tcp};
                 std::atomic<bool> isRunning_{false};
             };
 
-            Server::Server(std::function<void(const std::string &)> logCallback) : serverImpl_(std::make_unique<Server::ServerImpl>(logCallback)) {}
+            Server::Server(std::function<void(std::string_view)> logCallback)
+                : Server(LogCallback([logCallback](LogLevel, std::string_view message)
+                                     { logCallback(message); })) {}
+
+            Server::Server(LogCallback logCallback) : serverImpl_(std::make_unique<Server::ServerImpl>(std::move(logCallback))) {}
 
             Server::~Server()
             {
@@ -277,6 +1223,54 @@ namespace libs
 
                 return serverImpl_->stop();
             }
+
+            bool Server::send(ConnectionId connectionId, const std::string &message)
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return serverImpl_->send(connectionId, message);
+            }
+
+            bool Server::sendFile(ConnectionId connectionId, int fileFD, off_t offset, std::size_t count)
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return serverImpl_->sendFile(connectionId, fileFD, offset, count);
+            }
+
+            bool Server::sendPipe(ConnectionId connectionId, int pipeFD, std::size_t count)
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return serverImpl_->sendPipe(connectionId, pipeFD, count);
+            }
+
+            DatagramCounters Server::datagramCounters() const
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return serverImpl_->datagramCounters();
+            }
+
+            std::vector<ClientStatistics> Server::clientStatistics(bool refresh)
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return serverImpl_->clientStatistics(refresh);
+            }
+
+            std::vector<ClientStatistics> Server::topClients(std::size_t count, bool refresh)
+            {
+                if (!serverImpl_)
+                    throw std::runtime_error("Implementation is not created");
+
+                return network::topClients(serverImpl_->clientStatistics(refresh), count);
+            }
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <charconv>
+
+#define STATISTICS_PENDING_TAIL_SIZE 256
+
+namespace
+{
+    // Client messages look like: [timestamp] "title". A chunk may hold several of them,
+    // `parsed` is set past the last complete one
+    std::string_view parseTitle(std::string_view message, std::size_t &messagesCount, std::size_t &parsed)
+    {
+        messagesCount = 0;
+        parsed = 0;
+        std::string_view title;
+
+        std::size_t position = 0;
+        while (true)
+        {
+            const std::size_t kOpening = message.find("] \"", position);
+            if (kOpening == std::string_view::npos)
+                break;
+
+            const std::size_t kBegin = kOpening + 3;
+            const std::size_t kEnd = message.find('"', kBegin);
+            if (kEnd == std::string_view::npos)
+                break;
+
+            if (title.empty())
+                title = message.substr(kBegin, kEnd - kBegin);
+
+            ++messagesCount;
+            position = kEnd + 1;
+            parsed = position;
+        }
+
+        return title;
+    }
+
+    // Beginning of a message cut by the end of the chunk, empty if there is none
+    std::string_view unfinishedTail(std::string_view rest)
+    {
+        const std::size_t kBegin = rest.rfind('[');
+        if (kBegin == std::string_view::npos)
+            return {};
+
+        return rest.substr(kBegin);
+    }
+}
+
+namespace libs
+{
+    namespace network
+    {
+        void StatisticsShard::update(ConnectionId connectionId, std::string_view message)
+        {
+            std::string_view text = message;
+            std::uint64_t bytes = message.size();
+
+            // The previous chunk ended inside a message, it is parsed joined with this one.
+            // Rare, so only this case allocates
+            std::string joined;
+            if (!pending_.empty())
+            {
+                auto it = pending_.find(connectionId);
+                if (it != pending_.end())
+                {
+                    joined = std::move(it->second.tail_);
+                    joined.append(message);
+                    text = joined;
+                    bytes += it->second.bytes_;
+                    pending_.erase(it);
+                }
+            }
+
+            std::size_t messagesCount = 0;
+            std::size_t parsed = 0;
+            std::string_view title = parseTitle(text, messagesCount, parsed);
+
+            const std::string_view kTail = isStream_ ? unfinishedTail(text.substr(parsed)) : std::string_view();
+            if (!kTail.empty() && kTail.size() <= STATISTICS_PENDING_TAIL_SIZE)
+            {
+                // Bytes without a title wait for it, the message is counted once complete
+                pending_[connectionId] = {std::string(kTail), messagesCount == 0 ? bytes : 0};
+                if (messagesCount == 0)
+                    return;
+            }
+
+            // Unknown format, account to the connection
+            char connectionTitle[32] = "#";
+            if (title.empty())
+            {
+                auto [end, ec] = std::to_chars(connectionTitle + 1, connectionTitle + sizeof(connectionTitle), connectionId);
+                title = std::string_view(connectionTitle, ec == std::errc() ? end - connectionTitle : 1);
+                messagesCount = 1;
+            }
+
+            account(title, messagesCount, bytes);
+        }
+
+        void StatisticsShard::forget(ConnectionId connectionId)
+        {
+            if (!pending_.empty())
+                pending_.erase(connectionId);
+        }
+
+        void StatisticsShard::account(std::string_view title, std::size_t messagesCount, std::uint64_t bytes)
+        {
+            auto it = table_.find(title);
+            if (it == table_.end())
+                it = table_.emplace(std::string(title), Entry{}).first;
+
+            Entry &entry = it->second;
+            entry.counters_.messages_ += messagesCount;
+            entry.counters_.bytes_ += bytes;
+            entry.counters_.lastSeen_ = std::chrono::system_clock::now();
+
+            if (!entry.isDirty_)
+            {
+                entry.isDirty_ = true;
+                dirty_.push_back(&*it);
+            }
+        }
+
+        // Only entries changed since the last publish are copied, and only new titles
+        // allocate, so the owner holds the lock briefly even for a large table
+        void StatisticsShard::publish(std::uint64_t epoch)
+        {
+            {
+                std::lock_guard<std::mutex> lock(publishMutex_);
+
+                for (auto *item : dirty_)
+                {
+                    const auto &[title, entry] = *item;
+                    const Counters &kCounters = entry.counters_;
+
+                    if (entry.publishedIndex_ == kNotPublished)
+                    {
+                        item->second.publishedIndex_ = published_.size();
+                        published_.push_back({title, kCounters.messages_, kCounters.bytes_, kCounters.lastSeen_});
+                    }
+                    else
+                    {
+                        ClientStatistics &statistics = published_[entry.publishedIndex_];
+                        statistics.messages_ = kCounters.messages_;
+                        statistics.bytes_ = kCounters.bytes_;
+                        statistics.lastSeen_ = kCounters.lastSeen_;
+                    }
+
+                    item->second.isDirty_ = false;
+                }
+
+                publishedEpoch_.store(std::max(epoch, publishedEpoch_.load()));
+            }
+
+            dirty_.clear();
+            lastPublishTime_ = std::chrono::steady_clock::now();
+        }
+
+        bool StatisticsShard::isPublishDue(std::uint64_t requestedEpoch, std::chrono::milliseconds interval) const
+        {
+            if (requestedEpoch > publishedEpoch_.load())
+                return true;
+
+            return interval.count() > 0 && std::chrono::steady_clock::now() - lastPublishTime_ >= interval;
+        }
+
+        std::uint64_t StatisticsShard::publishedEpoch() const
+        {
+            return publishedEpoch_.load();
+        }
+
+        void StatisticsShard::mergeTo(ClientStatisticsMap &merged) const
+        {
+            std::lock_guard<std::mutex> lock(publishMutex_);
+
+            for (const auto &statistics : published_)
+            {
+                auto [it, isInserted] = merged.try_emplace(statistics.title_, statistics);
+                if (isInserted)
+                    continue;
+
+                it->second.messages_ += statistics.messages_;
+                it->second.bytes_ += statistics.bytes_;
+                it->second.lastSeen_ = std::max(it->second.lastSeen_, statistics.lastSeen_);
+            }
+        }
+
+        std::vector<ClientStatistics> topClients(std::vector<ClientStatistics> statistics, std::size_t count)
+        {
+            count = std::min(count, statistics.size());
+
+            std::partial_sort(statistics.begin(), statistics.begin() + count, statistics.end(),
+                              [](const ClientStatistics &lhs, const ClientStatistics &rhs)
+                              {
+                                  if (lhs.bytes_ != rhs.bytes_)
+                                      return lhs.bytes_ > rhs.bytes_;
+                                  return lhs.messages_ > rhs.messages_;
+                              });
+
+            statistics.resize(count);
+            return statistics;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "network.h"
+
+namespace libs
+{
+    namespace network
+    {
+        struct StringHash
+        {
+            using is_transparent = void;
+
+            std::size_t operator()(std::string_view value) const
+            {
+                return std::hash<std::string_view>()(value);
+            }
+        };
+
+        using ClientStatisticsMap = std::unordered_map<std::string, ClientStatistics, StringHash, std::equal_to<>>;
+
+        // Per-client counters owned by a single thread (worker or reactor), so updates
+        // take no locks. Readers only see copies published by the owner on request
+        class StatisticsShard
+        {
+        public:
+            // isStream - a message may be split between chunks of a connection,
+            // false for datagrams
+            explicit StatisticsShard(bool isStream) : isStream_(isStream) {}
+
+            StatisticsShard(const StatisticsShard &) = delete;
+            StatisticsShard &operator=(const StatisticsShard &) = delete;
+
+            // Owner thread only
+            void update(ConnectionId connectionId, std::string_view message);
+            void forget(ConnectionId connectionId);
+            void publish(std::uint64_t epoch);
+            bool isPublishDue(std::uint64_t requestedEpoch, std::chrono::milliseconds interval) const;
+
+            // Any thread
+            std::uint64_t publishedEpoch() const;
+            void mergeTo(ClientStatisticsMap &merged) const;
+
+        private:
+            struct Counters
+            {
+                std::uint64_t messages_{0};
+                std::uint64_t bytes_{0};
+                std::chrono::system_clock::time_point lastSeen_{};
+            };
+
+            struct Entry
+            {
+                Counters counters_;
+                std::size_t publishedIndex_{kNotPublished};
+                bool isDirty_{false};
+            };
+
+            // Beginning of a message the chunk ended in, with the chunk bytes waiting for its title
+            struct Pending
+            {
+                std::string tail_;
+                std::uint64_t bytes_{0};
+            };
+
+            using Table = std::unordered_map<std::string, Entry, StringHash, std::equal_to<>>;
+
+            static constexpr std::size_t kNotPublished{static_cast<std::size_t>(-1)};
+
+            void account(std::string_view title, std::size_t messagesCount, std::uint64_t bytes);
+
+            const bool isStream_;
+            Table table_;
+            std::unordered_map<ConnectionId, Pending> pending_;
+
+            // Entries changed since the last publish, only they are copied
+            std::vector<Table::value_type *> dirty_;
+            std::chrono::steady_clock::time_point lastPublishTime_{};
+
+            mutable std::mutex publishMutex_;
+            std::vector<ClientStatistics> published_; // in order of Entry::publishedIndex_
+            std::atomic<std::uint64_t> publishedEpoch_{0};
+        };
+
+        // Heaviest senders by bytes, then by messages
+        std::vector<ClientStatistics> topClients(std::vector<ClientStatistics> statistics, std::size_t count);
+    }
+}
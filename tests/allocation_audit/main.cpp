@@ -0,0 +1,246 @@
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "logger.h"
+#include "network.h"
+
+// Counts every heap allocation of the process while the audit is on. The server
+// receive, callback and log path must not allocate once connections are warmed up
+
+#define SERVER_PORT 18181
+#define WARM_UP_MESSAGES 300
+#define AUDITED_MESSAGES 500
+#define LARGE_MESSAGE_SIZE 900
+#define MESSAGE_TIMEOUT_MILLISECONDS 2000
+
+namespace
+{
+    std::atomic<bool> isAuditing{false};
+    std::atomic<long> allocations{0};
+
+    void *allocate(std::size_t size, std::size_t alignment = 0)
+    {
+        if (isAuditing.load(std::memory_order_relaxed))
+            allocations.fetch_add(1, std::memory_order_relaxed);
+
+        if (size == 0)
+            size = 1;
+
+        if (alignment == 0)
+            return std::malloc(size);
+
+        return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *pointer = allocate(size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    if (void *pointer = allocate(size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void *pointer = allocate(size, static_cast<std::size_t>(alignment)))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    if (void *pointer = allocate(size, static_cast<std::size_t>(alignment)))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { std::free(pointer); }
+
+namespace
+{
+    std::atomic<long> receivedMessages{0};
+
+    int connectToServer()
+    {
+        const int kFD = socket(AF_INET, SOCK_STREAM, 0);
+        if (kFD == -1)
+            return -1;
+
+        sockaddr_in serverAddr{};
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(SERVER_PORT);
+        inet_pton(AF_INET, "127.0.0.1", &serverAddr.sin_addr);
+
+        if (connect(kFD, (sockaddr *)&serverAddr, sizeof(serverAddr)) == -1)
+        {
+            close(kFD);
+            return -1;
+        }
+
+        return kFD;
+    }
+
+    // Waits until the server passed the message to the callback, so messages
+    // arrive one per read and aren't merged by the socket
+    bool sendMessage(int fd, const std::string &message)
+    {
+        const long kExpected = receivedMessages.load() + 1;
+        if (write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+            return false;
+
+        const auto kDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MESSAGE_TIMEOUT_MILLISECONDS);
+        while (receivedMessages.load() < kExpected)
+        {
+            if (std::chrono::steady_clock::now() >= kDeadline)
+                return false;
+
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        return true;
+    }
+
+    bool sendOnConnection(int fd, const std::string &message, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            if (!sendMessage(fd, message))
+                return false;
+
+        return true;
+    }
+
+    bool sendReconnecting(const std::string &message, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const int kFD = connectToServer();
+            if (kFD == -1)
+                return false;
+
+            const bool kSent = sendMessage(kFD, message);
+            close(kFD);
+
+            if (!kSent)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Runs the warmed up scenario with the allocation counter on, returns false if it allocated
+    template <typename Scenario>
+    bool audit(const char *title, Scenario &&scenario)
+    {
+        if (!scenario(WARM_UP_MESSAGES))
+        {
+            std::cerr << title << ": warm up failed" << std::endl;
+            return false;
+        }
+
+        allocations.store(0);
+        isAuditing.store(true);
+        const bool kSent = scenario(AUDITED_MESSAGES);
+        // Let the logger catch up, its formatting is audited too
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        isAuditing.store(false);
+
+        std::cerr << title << ": " << allocations.load() << " allocations per "
+                  << AUDITED_MESSAGES << " messages" << std::endl;
+
+        return kSent && allocations.load() == 0;
+    }
+}
+
+int main()
+{
+    const std::string kSmallMessage("[2026-01-01 00:00:00.000] \"allocation audit\"");
+    std::string largeMessage(kSmallMessage);
+    largeMessage.resize(LARGE_MESSAGE_SIZE, '.');
+
+    libs::network::server::Server server([](std::string_view message)
+                                         {
+                                             LOG(message);
+                                             receivedMessages.fetch_add(1);
+                                         });
+
+    libs::network::server::Server::Config config;
+    config.port_ = SERVER_PORT;
+    std::thread serverThread([&server, &config]()
+                             { server.start(config); });
+
+    int fd = -1;
+    for (int attempt = 0; attempt < 100 && fd == -1; ++attempt)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        fd = connectToServer();
+    }
+
+    bool isPassed = fd != -1;
+    if (isPassed)
+    {
+        const bool kSmallPassed = audit("Small messages", [&](int count)
+                                        { return sendOnConnection(fd, kSmallMessage, count); });
+        const bool kLargePassed = audit("Large messages", [&](int count)
+                                        { return sendOnConnection(fd, largeMessage, count); });
+        const bool kReconnectPassed = audit("Reconnect per message", [&](int count)
+                                            { return sendReconnecting(kSmallMessage, count); });
+
+        isPassed = kSmallPassed && kLargePassed && kReconnectPassed;
+
+        close(fd);
+    }
+    else
+    {
+        std::cerr << "Failed to connect to server" << std::endl;
+    }
+
+    server.stop();
+    serverThread.join();
+
+    return isPassed ? 0 : 1;
+}
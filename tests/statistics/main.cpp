@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "statistics.h"
+
+// Feeds chunks the way workers and the reactor read them and checks the merged
+// per-client counters, messages split between chunks have to be counted once
+
+#define PENDING_TAIL_SIZE 256
+
+namespace
+{
+    using libs::network::ClientStatisticsMap;
+    using libs::network::StatisticsShard;
+
+    ClientStatisticsMap merge(const StatisticsShard &stream, const StatisticsShard &datagrams)
+    {
+        ClientStatisticsMap merged;
+        stream.mergeTo(merged);
+        datagrams.mergeTo(merged);
+        return merged;
+    }
+
+    bool check(const ClientStatisticsMap &merged, const std::string &title,
+               std::uint64_t messages, std::uint64_t bytes)
+    {
+        auto it = merged.find(title);
+        if (it == merged.end())
+        {
+            std::cerr << title << ": missing" << std::endl;
+            return false;
+        }
+
+        if (it->second.messages_ != messages || it->second.bytes_ != bytes)
+        {
+            std::cerr << title << ": " << it->second.messages_ << " messages, " << it->second.bytes_
+                      << " bytes, expected " << messages << ", " << bytes << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main()
+{
+    StatisticsShard stream(true);
+    StatisticsShard datagrams(false);
+
+    // Message split inside the title
+    stream.update(1, "[t] \"be");
+    stream.update(1, "ta\"");
+
+    stream.publish(1);
+    ClientStatisticsMap merged = merge(stream, datagrams);
+    bool isPassed = check(merged, "beta", 1, 10) && merged.size() == 1;
+
+    // Several messages per chunk, the last one cut right after its opening bracket
+    stream.update(2, "[t] \"a\"[t] \"a\"[t] \"a\"");
+    stream.update(2, "[t] \"a\"[t] \"a\"[t");
+    stream.update(2, "] \"a\"");
+
+    // Tail longer than the limit isn't kept, both chunks are accounted to the connection
+    stream.update(3, "[" + std::string(PENDING_TAIL_SIZE, 'x'));
+    stream.update(3, "y\"");
+
+    // Bytes of chunks without a complete message carry over until it ends
+    stream.update(4, "[t] \"lo");
+    stream.update(4, "ng");
+    stream.update(4, "\"");
+
+    // Closed connection's tail isn't joined with a new one reusing the id
+    stream.update(6, "[t] \"gone");
+    stream.forget(6);
+    stream.update(6, "[t] \"new\"");
+
+    // Datagrams are never joined
+    datagrams.update(5, "[t] \"da");
+    datagrams.update(5, "ta\"");
+
+    stream.publish(2);
+    datagrams.publish(2);
+    merged = merge(stream, datagrams);
+
+    isPassed = check(merged, "beta", 1, 10) && isPassed;
+    isPassed = check(merged, "a", 6, 42) && isPassed;
+    isPassed = check(merged, "#3", 2, PENDING_TAIL_SIZE + 3) && isPassed;
+    isPassed = check(merged, "long", 1, 10) && isPassed;
+    isPassed = check(merged, "new", 1, 9) && isPassed;
+    isPassed = check(merged, "#5", 2, 10) && isPassed;
+
+    if (merged.size() != 6)
+    {
+        std::cerr << "Unexpected titles:";
+        for (const auto &[title, statistics] : merged)
+            std::cerr << " " << title;
+        std::cerr << std::endl;
+        isPassed = false;
+    }
+
+    std::cerr << (isPassed ? "Statistics merged correctly" : "Statistics test failed") << std::endl;
+
+    return isPassed ? 0 : 1;
+}